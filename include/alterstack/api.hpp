@@ -20,3 +20,9 @@
 #pragma once
 
 #include "alterstack/task.hpp"
+#include "alterstack/mutex.hpp"
+#include "alterstack/condition_variable.hpp"
+#include "alterstack/semaphore.hpp"
+#include "alterstack/event.hpp"
+#include "alterstack/channel.hpp"
+#include "alterstack/future.hpp"
@@ -90,16 +90,21 @@ private:
     /**
      * @brief insert current task in wait list
      *
-     * If this Awaitable still waited current task will be inserted in wait list,
+     * If data is still waited current task will be inserted in wait list,
      * current_task->m_context = nullptr;
      * and function returns true
      *
-     * If this Awaitable got finished before function complete insert_current_task_in_waitlist()
+     * If data got finished before function complete insert_current_task_in_waitlist()
      * do nothing and returns false
+     *
+     * Shared by Awaitable and Event (both keep AwaitableData word).
+     * @param data wait list and finished flag
      * @return true if this still waited or false if finished
      */
-    bool insert_current_task_in_waitlist();
+    static bool insert_current_task_in_waitlist( ::std::atomic<AwaitableData>& data );
     ::std::atomic<AwaitableData> m_data;
+
+    friend class Event;
 };
 
 inline Awaitable::Awaitable()
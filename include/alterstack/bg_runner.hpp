@@ -20,17 +20,51 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include "bg_thread.hpp"
 
 namespace alterstack
 {
 class Scheduler;
+class TaskBase;
+/**
+ * @brief BgThread CPU affinity mode
+ */
+enum class ThreadAffinity
+{
+    None,    ///< BgThread's are not pinned, OS moves them freely
+    PerCore, ///< BgThread i is pinned to core i (round robin if more BgThread's than cores)
+};
 /**
  * @brief Creates pool of threads which runs Task in background
+ *
+ * Pool is elastic: max_running BgThread objects are created, min_spare of them
+ * started at once. New BgThread is started when all running BgThread's stay busy
+ * (nobody sleeping) while Tasks are enqueued for longer than GROW_DELAY_NS.
+ * BgThread sleeping longer than idle_timeout() retires (stops it's OS thread)
+ * if there are more than min_spare running.
+ *
+ * Parked BgThread's are kept in idle stack (lockfree Treiber stack of BgThread
+ * indexes with version tag against ABA), notify() wakes up single BgThread from it
+ * and does nothing while some BgThread is spinning (looking for Task).
+ *
+ * BgThread without Task spins (polls run queues) up to max_spin_iterations()
+ * before park, spin budget adapts to recent hit rate. No more than
+ * max_spinning_threads() BgThread's spin at the same time.
+ *
+ * With ThreadAffinity::PerCore each BgThread is pinned to its own core and
+ * steals Tasks from BgThread's sharing L2 cache first, then L3, then same
+ * NUMA node, then others (see CpuTopology).
+ *
+ * With Scheduler NUMA domains (Scheduler::set_numa_domains()) each BgThread
+ * belongs to domain of it's NUMA node (BgThread's not pinned to cores are
+ * spread over nodes and pinned to node CPUs) and steals from other domains
+ * only after nothing found in it's own domain.
  */
 class BgRunner
 {
@@ -38,15 +72,100 @@ public:
     BgRunner() = delete;
     explicit BgRunner(
             Scheduler* scheduler
-            ,uint32_t min_spare = 1
-            ,uint32_t max_running = std::thread::hardware_concurrency() );
+            ,uint32_t min_spare = default_min_spare()
+            ,uint32_t max_running = default_max_running() );
     ~BgRunner();
 
+    void stop();
     void notify_all();
     void notify();
+    TaskBase* steal( BgThread* thief, bool other_domains ) noexcept;
+
+    bool try_retire() noexcept;
+    void cancel_retire() noexcept;
+    void set_idle() noexcept;
+    void park( BgThread* thread ) noexcept;
+    bool try_begin_spinning() noexcept;
+    uint32_t end_spinning() noexcept;
+    uint32_t max_spinning_threads() const noexcept;
+    uint32_t running_count() const noexcept;
+    void begin_sleep() noexcept;
+    void end_sleep() noexcept;
+    uint32_t sleep_count() const noexcept;
+
+    static uint32_t default_min_spare() noexcept;
+    static uint32_t default_max_running() noexcept;
+    static void set_thread_limits( uint32_t min_spare, uint32_t max_running ) noexcept;
+    static std::chrono::milliseconds idle_timeout() noexcept;
+    static void set_idle_timeout( std::chrono::milliseconds timeout ) noexcept;
+    static uint32_t max_spin_iterations() noexcept;
+    static void set_spin_limits( uint32_t max_spin_iterations
+                                 ,uint32_t max_spinning_threads ) noexcept;
+    static void set_thread_affinity( ThreadAffinity affinity
+                                     ,const std::vector<uint32_t>& cpus = {} );
 
 private:
+    void grow() noexcept;
+    bool start_thread() noexcept;
+    bool start_thread( BgThread* thread ) noexcept;
+    BgThread* pop_idle() noexcept;
+    void assign_cores( uint32_t domain_count );
+
+    /// start new BgThread if Tasks are enqueued while all BgThread's busy this long
+    static constexpr int64_t GROW_DELAY_NS = 100000;
+
     ::std::deque<std::unique_ptr<BgThread>> m_cpu_core_list;
+    const uint32_t        m_min_spare;             ///< BgThread's running always
+    const uint32_t        m_max_running;           ///< BgThread objects count
+    std::atomic<uint32_t> m_running_count{ 0 };    ///< started and not retired BgThread's
+    std::atomic<int64_t>  m_backlog_since_ns{ 0 }; ///< when all BgThread's became busy or 0
+    std::atomic<uint32_t> m_spinning_count{ 0 };   ///< BgThread's looking for Task
+    std::atomic<uint32_t> m_sleep_count{ 0 };      ///< BgThread's sleeping on their Futex
+    std::atomic<uint64_t> m_idle_head{ 0 };        ///< version << 32 | (top BgThread index + 1)
 };
 
+inline uint32_t BgRunner::running_count() const noexcept
+{
+    return m_running_count.load( std::memory_order_acquire );
+}
+/**
+ * @brief mark that some BgThread has no work (reset busy period)
+ */
+inline void BgRunner::set_idle() noexcept
+{
+    m_backlog_since_ns.store( 0, std::memory_order_relaxed );
+}
+/**
+ * @brief BgThread stopped looking for Task
+ *
+ * If it did not find Task it MUST check queues again after park()
+ * @return spinning BgThread's count left
+ */
+inline uint32_t BgRunner::end_spinning() noexcept
+{
+    return m_spinning_count.fetch_sub( 1, std::memory_order_seq_cst ) - 1;
+}
+/**
+ * @brief BgThread of this BgRunner goes to sleep on its Futex
+ */
+inline void BgRunner::begin_sleep() noexcept
+{
+    m_sleep_count.fetch_add( 1, std::memory_order_relaxed );
+}
+/**
+ * @brief BgThread of this BgRunner woke up
+ */
+inline void BgRunner::end_sleep() noexcept
+{
+    m_sleep_count.fetch_sub( 1, std::memory_order_relaxed );
+}
+/**
+ * @brief get sleeping BgThread's count of this BgRunner
+ * @return number of currently sleeping BgThread's
+ */
+inline uint32_t BgRunner::sleep_count() const noexcept
+{
+    return m_sleep_count.load( std::memory_order_acquire );
+}
+
 }
@@ -20,14 +20,20 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "alterstack/futex.hpp"
+#include "alterstack/work_stealing_queue.hpp"
 
 namespace alterstack
 {
 class BgRunner;
 class Scheduler;
+class TaskBase;
+using LocalRunQueue = WorkStealingQueue<TaskBase>;
 /**
  * @brief Single Task background runner thread.
  */
@@ -40,10 +46,18 @@ public:
     BgThread& operator=(BgThread&&) = delete;
     BgThread() = delete;
     /**
-     * @brief start one OS thread
-     * @param bg_runner reference to BgRunner
+     * @brief create BgThread, OS thread will be started by start()
+     * @param scheduler Scheduler pointer
+     * @param index index of this BgThread in BgRunner
      */
-    explicit BgThread(Scheduler* scheduler);
+    BgThread(Scheduler* scheduler, uint32_t index);
+    /**
+     * @brief start one OS thread (BgThread MUST be activated by try_activate())
+     */
+    void start();
+    bool try_activate() noexcept;
+    void deactivate() noexcept;
+    bool is_active() const noexcept;
     /**
      * @brief destructor stops OS thread, return when it's stopped
      */
@@ -60,27 +74,61 @@ public:
     void stop_thread();
     void wake_up();
     /**
-     * @brief get current waiting BgThread threads count
-     * @return number of currently sleeping threads
+     * @brief get this BgThread local run queue
+     *
+     * Only this BgThread puts Tasks here, other BgThread's can steal them.
+     * @return local run queue reference
      */
-    static uint32_t sleep_count();
+    LocalRunQueue& local_queue() noexcept;
+    uint32_t next_schedule_tick() noexcept;
+    uint32_t next_random() noexcept;
+
+    uint32_t index() const noexcept;
+    Scheduler* scheduler() const noexcept;
+    int32_t  core() const noexcept;
+    void     set_core( int32_t core ) noexcept;
+    uint32_t numa_domain() const noexcept;
+    void     set_numa_domain( uint32_t domain, int32_t bind_node ) noexcept;
+    const std::vector<std::vector<uint32_t>>& victim_groups() const noexcept;
+    uint32_t local_group_count() const noexcept;
+    void set_victim_groups( std::vector<std::vector<uint32_t>> victim_groups
+                            ,uint32_t local_group_count );
+    std::atomic<bool>&     in_idle_stack() noexcept;
+    std::atomic<uint32_t>& next_idle() noexcept;
 
 private:
     void thread_function();
+    void run();
     /**
      * @brief ensure that thread function stopped, wait until stop
      */
     void ensure_thread_stopped();
     bool is_stop_requested();
-    void wait();
+    bool wait( std::chrono::milliseconds timeout );
+    TaskBase* spin( BgRunner& runner );
+
+    /// min spin budget, budget adapts between it and BgRunner::max_spin_iterations()
+    static constexpr uint32_t MIN_SPIN_ITERATIONS = 8;
 
     Scheduler*        scheduler_;       //!< Scheduler reference
     std::thread       m_os_thread;         //!< OS thread
-    std::atomic<bool> m_thread_stopped; //!< true if thread_function stopped
+    std::thread       m_retired_thread;    //!< previous (retired) OS thread, joined by m_os_thread
+    std::atomic<uint32_t> m_thread_count{ 0 }; //!< OS threads not finished thread_function yet
     std::atomic<bool> m_stop_requested; //!< true when current BgThread need to stop
+    std::atomic<bool> m_is_active{ false }; //!< true while OS thread started and not retired
+    std::atomic<bool> m_in_idle_stack{ false }; //!< true while BgThread is in BgRunner idle stack
+    std::atomic<uint32_t> m_next_idle{ 0 };   //!< next idle BgThread index + 1 (0 - none)
+    const uint32_t    m_index;             //!< index in BgRunner
+    int32_t           m_core = -1;         //!< CpuTopology core to pin or -1
+    int32_t           m_bind_node = -1;    //!< NUMA node to pin (if not pinned to core) or -1
+    uint32_t          m_numa_domain = 0;   //!< Scheduler NUMA domain
+    std::vector<std::vector<uint32_t>> m_victim_groups; //!< steal order, closest group first
+    uint32_t          m_local_group_count = 0; //!< victim groups in the same NUMA domain
     Futex             m_task_avalable_futex; //!< Futex to wait for new tasks
-
-    static ::std::atomic<uint32_t> m_sleep_count;
+    uint32_t          m_schedule_tick = 0; //!< schedule calls counter (owner thread only)
+    uint32_t          m_random_state;      //!< xorshift state to select steal victim
+    uint32_t          m_spin_budget = ~0u; //!< current spin iterations before park
+    LocalRunQueue     m_local_queue;       //!< Tasks made Running by this BgThread
 };
 
 inline void BgThread::request_stop()
@@ -88,14 +136,143 @@ inline void BgThread::request_stop()
     m_stop_requested.store( true, std::memory_order_release );
 }
 
+/**
+ * @brief reserve this BgThread to start OS thread in it
+ * @return true if BgThread was not active
+ */
+inline bool BgThread::try_activate() noexcept
+{
+    bool is_active = false;
+    return m_is_active.compare_exchange_strong( is_active, true, std::memory_order_acq_rel );
+}
+/**
+ * @brief mark BgThread as not active (it can be started again)
+ */
+inline void BgThread::deactivate() noexcept
+{
+    m_is_active.store( false, std::memory_order_seq_cst );
+}
+
+inline bool BgThread::is_active() const noexcept
+{
+    return m_is_active.load( std::memory_order_seq_cst );
+}
+
+inline uint32_t BgThread::index() const noexcept
+{
+    return m_index;
+}
+
+/**
+ * @brief get Scheduler owning this BgThread
+ * @return Scheduler pointer
+ */
+inline Scheduler* BgThread::scheduler() const noexcept
+{
+    return scheduler_;
+}
+
+inline int32_t BgThread::core() const noexcept
+{
+    return m_core;
+}
+/**
+ * @brief set core to pin OS thread at start
+ * @param core CpuTopology core index or -1 (do not pin)
+ */
+inline void BgThread::set_core( int32_t core ) noexcept
+{
+    m_core = core;
+}
+
+inline uint32_t BgThread::numa_domain() const noexcept
+{
+    return m_numa_domain;
+}
+/**
+ * @brief set Scheduler NUMA domain of this BgThread
+ * @param domain Scheduler NUMA domain index
+ * @param bind_node CpuTopology NUMA node to pin OS thread at start (if it is
+ * not pinned to core) or -1 (do not pin)
+ */
+inline void BgThread::set_numa_domain( uint32_t domain, int32_t bind_node ) noexcept
+{
+    m_numa_domain = domain;
+    m_bind_node   = bind_node;
+}
+/**
+ * @brief get BgThread indexes to steal from, grouped by distance (closest first)
+ * @return victim groups
+ */
+inline const std::vector<std::vector<uint32_t>>& BgThread::victim_groups() const noexcept
+{
+    return m_victim_groups;
+}
+/**
+ * @brief get number of first victim_groups() in the same NUMA domain
+ * @return local victim groups count
+ */
+inline uint32_t BgThread::local_group_count() const noexcept
+{
+    return m_local_group_count;
+}
+/**
+ * @brief set steal order
+ * @param victim_groups BgThread indexes grouped by distance (closest first)
+ * @param local_group_count number of first groups in the same NUMA domain
+ */
+inline void BgThread::set_victim_groups( std::vector<std::vector<uint32_t>> victim_groups
+                                         ,uint32_t local_group_count )
+{
+    m_victim_groups     = std::move( victim_groups );
+    m_local_group_count = local_group_count;
+}
+/**
+ * @brief flag set by BgThread pushing itself in idle stack, cleared by thread popped it
+ * @return flag reference
+ */
+inline std::atomic<bool>& BgThread::in_idle_stack() noexcept
+{
+    return m_in_idle_stack;
+}
+/**
+ * @brief idle stack link (next BgThread index + 1)
+ * @return link reference
+ */
+inline std::atomic<uint32_t>& BgThread::next_idle() noexcept
+{
+    return m_next_idle;
+}
+
 inline bool BgThread::is_stop_requested()
 {
     return  __builtin_expect( m_stop_requested.load(std::memory_order_acquire), false );
 }
 
-inline uint32_t BgThread::sleep_count()
+inline LocalRunQueue& BgThread::local_queue() noexcept
+{
+    return m_local_queue;
+}
+/**
+ * @brief count schedule calls of this BgThread (owner thread only)
+ * @return next schedule tick number
+ */
+inline uint32_t BgThread::next_schedule_tick() noexcept
+{
+    return ++m_schedule_tick;
+}
+/**
+ * @brief get next pseudo random number (xorshift32, owner thread only)
+ * @return pseudo random number
+ */
+inline uint32_t BgThread::next_random() noexcept
 {
-    return m_sleep_count.load(std::memory_order_acquire);
+    uint32_t x = m_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m_random_state = x;
+    return x;
 }
 
 }
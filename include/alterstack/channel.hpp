@@ -0,0 +1,556 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "alterstack/scheduler.hpp"
+#include "alterstack/spin_lock.hpp"
+#include "alterstack/task.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief MPMC Channel passing values between Task s
+ *
+ * Bounded Channel (capacity > 0) buffers up to capacity values, capacity 0 gives
+ * rendezvous Channel (sender waits receiver). Unbounded Channel (UNBOUNDED)
+ * buffer grows (doubles) when full, send() never waits.
+ *
+ * send() to full Channel and recv() from empty Channel park current Task
+ * (AlterNative Task switches to next running Task, Native Task sleeps on it's
+ * thread futex). Parked Tasks are kept in FIFO queues linked through TaskBase
+ * intrusive list, value pointer is kept on parked Task stack, so send()/recv()
+ * allocate nothing. Value is moved directly from parked sender to receiver (or
+ * from sender to parked receiver) without copying through the buffer.
+ *
+ * close() wakes up all parked Tasks: parked senders fail (value not sent),
+ * receivers get buffered values until buffer is empty and then fail. send() to
+ * closed Channel fails.
+ *
+ * Channel state is protected by SpinLock held only for queue manipulations,
+ * Tasks are woken up after it is released.
+ *
+ * T MUST be default constructible and nothrow movable: values are moved under
+ * m_lock after parked Task is taken from queue, throwing move would lose it.
+ *
+ * All methods are threadsafe. Channel MUST outlive all Tasks using it.
+ */
+template<typename T>
+class Channel
+{
+public:
+    static constexpr size_t UNBOUNDED = SIZE_MAX;
+
+    explicit Channel( size_t capacity = UNBOUNDED );
+    ~Channel();
+
+    Channel( const Channel& ) = delete;
+    Channel( Channel&& )      = delete;
+    Channel& operator=( const Channel& ) = delete;
+    Channel& operator=( Channel&& )      = delete;
+
+    bool send( T value );
+    bool try_send( T&& value );
+    bool try_send( const T& value );
+    bool recv( T& value );
+    bool try_recv( T& value );
+    size_t recv_many( std::vector<T>& values, size_t max_count );
+    void close() noexcept;
+
+    bool is_closed() const noexcept;
+    size_t capacity() const noexcept;
+    size_t size() const noexcept;
+
+private:
+    static_assert( std::is_nothrow_move_constructible<T>::value
+                   && std::is_nothrow_move_assignable<T>::value
+                   ,"Channel value type MUST be nothrow movable" );
+
+    using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+    /// value slot of parked Task, pointed by TaskBase::m_wait_data
+    struct Waiter
+    {
+        T*   value;
+        bool is_done; ///< false if woken up by close()
+    };
+    /// FIFO of parked Tasks linked by TaskBase::next()
+    struct WaitQueue
+    {
+        void push( TaskBase* task ) noexcept;
+        TaskBase* pop() noexcept;
+        TaskBase* take_all() noexcept;
+
+        TaskBase* head = nullptr;
+        TaskBase* tail = nullptr;
+    };
+
+    template<typename U>
+    bool try_send_locked( U&& value, TaskBase*& woken );
+    bool try_recv_locked( T& value, TaskBase*& woken );
+    void park( std::unique_lock<SpinLock>& guard, WaitQueue& queue, Waiter& waiter );
+    static void wake( TaskBase* task, bool is_done ) noexcept;
+    static void wake_list( TaskBase* task_list ) noexcept;
+
+    T* slot( size_t index ) noexcept;
+    bool buffer_is_full() const noexcept;
+    template<typename U>
+    void buffer_push( U&& value );
+    void buffer_pop( T& value );
+    void buffer_grow();
+
+    mutable SpinLock m_lock;
+    const size_t m_capacity;
+    std::unique_ptr<Storage[]> m_slots;
+    size_t m_slot_count = 0;
+    size_t m_head       = 0; ///< index of oldest buffered value
+    size_t m_size       = 0; ///< buffered values count
+    WaitQueue m_senders;
+    WaitQueue m_receivers;
+    bool m_is_closed = false;
+
+    /// first buffer size of UNBOUNDED Channel
+    static constexpr size_t INITIAL_SLOT_COUNT = 16;
+};
+
+template<typename T>
+constexpr size_t Channel<T>::UNBOUNDED;
+template<typename T>
+constexpr size_t Channel<T>::INITIAL_SLOT_COUNT;
+
+template<typename T>
+Channel<T>::Channel( size_t capacity )
+    :m_capacity{ capacity }
+    ,m_slot_count{ capacity == UNBOUNDED ? INITIAL_SLOT_COUNT : capacity }
+{
+    if( m_slot_count != 0 )
+    {
+        m_slots.reset( new Storage[ m_slot_count ] );
+    }
+}
+
+template<typename T>
+Channel<T>::~Channel()
+{
+    assert( m_senders.head == nullptr && m_receivers.head == nullptr );
+    for( size_t i = 0; i < m_size; ++i )
+    {
+        slot( m_head + i )->~T();
+    }
+}
+/**
+ * @brief send value, park current Task while Channel is full
+ * @param value value to send
+ * @return true if value sent, false if Channel closed
+ */
+template<typename T>
+bool Channel<T>::send( T value )
+{
+    std::unique_lock<SpinLock> guard( m_lock );
+    TaskBase* woken = nullptr;
+    if( try_send_locked( std::move( value ), woken ) )
+    {
+        guard.unlock();
+        wake_list( woken );
+        return true;
+    }
+    if( m_is_closed )
+    {
+        return false;
+    }
+    Waiter waiter{ &value, false };
+    park( guard, m_senders, waiter );
+    return waiter.is_done;
+}
+/**
+ * @brief send value if it is possible without waiting
+ * @param value value to send, moved out only on success
+ * @return true if value sent
+ */
+template<typename T>
+bool Channel<T>::try_send( T&& value )
+{
+    std::unique_lock<SpinLock> guard( m_lock );
+    TaskBase* woken = nullptr;
+    if( !try_send_locked( std::move( value ), woken ) )
+    {
+        return false;
+    }
+    guard.unlock();
+    wake_list( woken );
+    return true;
+}
+
+template<typename T>
+bool Channel<T>::try_send( const T& value )
+{
+    std::unique_lock<SpinLock> guard( m_lock );
+    TaskBase* woken = nullptr;
+    if( !try_send_locked( value, woken ) )
+    {
+        return false;
+    }
+    guard.unlock();
+    wake_list( woken );
+    return true;
+}
+/**
+ * @brief receive value, park current Task while Channel is empty
+ * @param value received value
+ * @return true if value received, false if Channel closed and empty
+ */
+template<typename T>
+bool Channel<T>::recv( T& value )
+{
+    std::unique_lock<SpinLock> guard( m_lock );
+    TaskBase* woken = nullptr;
+    if( try_recv_locked( value, woken ) )
+    {
+        guard.unlock();
+        wake_list( woken );
+        return true;
+    }
+    if( m_is_closed )
+    {
+        return false;
+    }
+    Waiter waiter{ &value, false };
+    park( guard, m_receivers, waiter );
+    return waiter.is_done;
+}
+/**
+ * @brief receive value if Channel is not empty
+ * @param value received value
+ * @return true if value received
+ */
+template<typename T>
+bool Channel<T>::try_recv( T& value )
+{
+    std::unique_lock<SpinLock> guard( m_lock );
+    TaskBase* woken = nullptr;
+    if( !try_recv_locked( value, woken ) )
+    {
+        return false;
+    }
+    guard.unlock();
+    wake_list( woken );
+    return true;
+}
+/**
+ * @brief receive up to max_count values, park current Task while Channel is empty
+ *
+ * Waits for first value like recv(), then takes everything available (up to
+ * max_count) under single lock.
+ * @param values received values are appended here
+ * @param max_count max values to receive
+ * @return received values count, 0 if Channel closed and empty
+ */
+template<typename T>
+size_t Channel<T>::recv_many( std::vector<T>& values, size_t max_count )
+{
+    if( max_count == 0 )
+    {
+        return 0;
+    }
+    T value;
+    if( !recv( value ) )
+    {
+        return 0;
+    }
+    values.push_back( std::move( value ) );
+    size_t count = 1;
+    TaskBase* woken_list = nullptr;
+    {
+        std::lock_guard<SpinLock> guard( m_lock );
+        TaskBase* woken = nullptr;
+        while( count < max_count
+               && try_recv_locked( value, woken ) )
+        {
+            values.push_back( std::move( value ) );
+            ++count;
+            if( woken != nullptr )
+            {
+                woken->set_next( woken_list );
+                woken_list = woken;
+                woken = nullptr;
+            }
+        }
+    }
+    wake_list( woken_list );
+    return count;
+}
+/**
+ * @brief close Channel and wake up all parked Tasks
+ */
+template<typename T>
+void Channel<T>::close() noexcept
+{
+    TaskBase* senders   = nullptr;
+    TaskBase* receivers = nullptr;
+    {
+        std::lock_guard<SpinLock> guard( m_lock );
+        m_is_closed = true;
+        senders   = m_senders.take_all();
+        receivers = m_receivers.take_all();
+    }
+    while( senders != nullptr )
+    {
+        TaskBase* task = senders;
+        senders = senders->next();
+        wake( task, false );
+    }
+    while( receivers != nullptr )
+    {
+        TaskBase* task = receivers;
+        receivers = receivers->next();
+        wake( task, false );
+    }
+}
+
+template<typename T>
+bool Channel<T>::is_closed() const noexcept
+{
+    std::lock_guard<SpinLock> guard( m_lock );
+    return m_is_closed;
+}
+
+template<typename T>
+size_t Channel<T>::capacity() const noexcept
+{
+    return m_capacity;
+}
+/**
+ * @brief buffered values count (snapshot)
+ * @return buffered values count
+ */
+template<typename T>
+size_t Channel<T>::size() const noexcept
+{
+    std::lock_guard<SpinLock> guard( m_lock );
+    return m_size;
+}
+/**
+ * @brief hand value over to parked receiver or put it in buffer
+ *
+ * m_lock MUST be locked.
+ * @param value value to send, moved out only on success
+ * @param woken receiver Task to wake up after m_lock released (or nullptr)
+ * @return true if value sent
+ */
+template<typename T>
+template<typename U>
+bool Channel<T>::try_send_locked( U&& value, TaskBase*& woken )
+{
+    if( m_is_closed )
+    {
+        return false;
+    }
+    TaskBase* receiver = m_receivers.pop();
+    if( receiver != nullptr )
+    {
+        // receivers are parked only while buffer is empty
+        Waiter* waiter = static_cast<Waiter*>( receiver->m_wait_data );
+        *waiter->value = std::forward<U>( value );
+        waiter->is_done = true;
+        woken = receiver;
+        return true;
+    }
+    if( buffer_is_full() )
+    {
+        if( m_capacity != UNBOUNDED )
+        {
+            return false;
+        }
+        buffer_grow();
+    }
+    buffer_push( std::forward<U>( value ) );
+    return true;
+}
+/**
+ * @brief take value from buffer or directly from parked sender
+ *
+ * Parked sender value goes to freed buffer slot, so FIFO order is kept.
+ * m_lock MUST be locked.
+ * @param value received value
+ * @param woken sender Task to wake up after m_lock released (or nullptr)
+ * @return true if value received
+ */
+template<typename T>
+bool Channel<T>::try_recv_locked( T& value, TaskBase*& woken )
+{
+    TaskBase* sender = m_senders.pop();
+    Waiter* waiter = ( sender != nullptr ) ? static_cast<Waiter*>( sender->m_wait_data ) : nullptr;
+    if( m_size != 0 )
+    {
+        buffer_pop( value );
+        if( waiter != nullptr )
+        {
+            buffer_push( std::move( *waiter->value ) );
+        }
+    }
+    else if( waiter != nullptr ) // rendezvous Channel
+    {
+        value = std::move( *waiter->value );
+    }
+    else
+    {
+        return false;
+    }
+    if( waiter != nullptr )
+    {
+        waiter->is_done = true;
+        woken = sender;
+    }
+    return true;
+}
+/**
+ * @brief park current Task in queue until woken up by other side or close()
+ *
+ * Task is marked Waiting before m_lock released (like Awaitable::wait()), it
+ * can be woken up before current thread switched it out.
+ * @param guard locked m_lock, unlocked on return
+ * @param queue senders or receivers queue
+ * @param waiter value slot on current Task stack
+ */
+template<typename T>
+void Channel<T>::park( std::unique_lock<SpinLock>& guard, WaitQueue& queue, Waiter& waiter )
+{
+    TaskBase* const current_task = Scheduler::get_current_task();
+    Scheduler::prepare_park( current_task );
+    current_task->m_wait_data = &waiter;
+    queue.push( current_task );
+    guard.unlock();
+    Scheduler::schedule( current_task );
+}
+
+template<typename T>
+void Channel<T>::wake( TaskBase* task, bool is_done ) noexcept
+{
+    static_cast<Waiter*>( task->m_wait_data )->is_done = is_done;
+    task->set_next( nullptr );
+    Scheduler::add_waiting_list_to_running( task );
+}
+
+template<typename T>
+void Channel<T>::wake_list( TaskBase* task_list ) noexcept
+{
+    if( task_list != nullptr )
+    {
+        Scheduler::add_waiting_list_to_running( task_list );
+    }
+}
+
+template<typename T>
+void Channel<T>::WaitQueue::push( TaskBase* task ) noexcept
+{
+    task->set_next( nullptr );
+    if( tail == nullptr )
+    {
+        head = task;
+    }
+    else
+    {
+        tail->set_next( task );
+    }
+    tail = task;
+}
+
+template<typename T>
+TaskBase* Channel<T>::WaitQueue::pop() noexcept
+{
+    TaskBase* task = head;
+    if( task != nullptr )
+    {
+        head = task->next();
+        if( head == nullptr )
+        {
+            tail = nullptr;
+        }
+        task->set_next( nullptr );
+    }
+    return task;
+}
+
+template<typename T>
+TaskBase* Channel<T>::WaitQueue::take_all() noexcept
+{
+    TaskBase* task_list = head;
+    head = nullptr;
+    tail = nullptr;
+    return task_list;
+}
+
+template<typename T>
+T* Channel<T>::slot( size_t index ) noexcept
+{
+    return reinterpret_cast<T*>( &m_slots[ index % m_slot_count ] );
+}
+
+template<typename T>
+bool Channel<T>::buffer_is_full() const noexcept
+{
+    return m_size == m_slot_count;
+}
+
+template<typename T>
+template<typename U>
+void Channel<T>::buffer_push( U&& value )
+{
+    new( slot( m_head + m_size ) ) T( std::forward<U>( value ) );
+    ++m_size;
+}
+
+template<typename T>
+void Channel<T>::buffer_pop( T& value )
+{
+    T* item = slot( m_head );
+    value = std::move( *item );
+    item->~T();
+    m_head = ( m_head + 1 ) % m_slot_count;
+    --m_size;
+}
+/**
+ * @brief double buffer of UNBOUNDED Channel, buffered values are moved
+ */
+template<typename T>
+void Channel<T>::buffer_grow()
+{
+    const size_t new_slot_count = m_slot_count * 2;
+    std::unique_ptr<Storage[]> new_slots( new Storage[ new_slot_count ] );
+    for( size_t i = 0; i < m_size; ++i )
+    {
+        T* item = slot( m_head + i );
+        new( &new_slots[ i ] ) T( std::move( *item ) );
+        item->~T();
+    }
+    m_slots = std::move( new_slots );
+    m_slot_count = new_slot_count;
+    m_head = 0;
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "alterstack/mutex.hpp"
+#include "alterstack/spin_lock.hpp"
+
+namespace alterstack
+{
+class TaskBase;
+/**
+ * @brief condition variable for Task s waiting with alterstack::Mutex
+ *
+ * wait() parks current Task (AlterNative Task switches to next running Task,
+ * Native Task sleeps on it's thread futex), OS thread is not blocked.
+ * Waiters are kept in intrusive TaskBase stack (like Awaitable wait list) in
+ * one 16 byte atomic with is_fifo_used flag. Notifier never walks shared
+ * stack (woken waiter can return from wait() and free it's Stack at any
+ * moment): notify_one() takes whole stack by one CAS, reverses it to FIFO
+ * list and wakes up the oldest waiter. FIFO list is used by notifiers only,
+ * under SpinLock held for few pointer operations. notify_one() and
+ * notify_all() without waiters are single atomic load.
+ *
+ * Current Task is inserted in waiters stack before Mutex unlocked, so notify
+ * done after wait() released Mutex is never lost. Spurious wakeups are
+ * possible only from notify issued for other waiters, use wait() with
+ * predicate.
+ *
+ * wait(), notify_one() and notify_all() are threadsafe
+ */
+class ConditionVariable
+{
+public:
+    ConditionVariable() noexcept;
+    ~ConditionVariable();
+
+    ConditionVariable( const ConditionVariable& ) = delete;
+    ConditionVariable( ConditionVariable&& )      = delete;
+    ConditionVariable& operator=( const ConditionVariable& ) = delete;
+    ConditionVariable& operator=( ConditionVariable&& )      = delete;
+
+    void wait( std::unique_lock<Mutex>& lock );
+    template<typename Predicate>
+    void wait( std::unique_lock<Mutex>& lock, Predicate predicate );
+    void notify_one() noexcept;
+    void notify_all() noexcept;
+
+    struct WaitListData
+    {
+        TaskBase* head;         ///< waiters stack top
+        uintptr_t is_fifo_used; ///< 1 while m_fifo has waiters
+    };
+private:
+    TaskBase* take_waiters() noexcept;
+
+    ::std::atomic<WaitListData> m_data;
+    SpinLock  m_notify_lock;    ///< serializes notifiers with waiters
+    TaskBase* m_fifo = nullptr; ///< waiters taken from m_data, oldest first
+};
+
+inline ConditionVariable::ConditionVariable() noexcept
+    :m_data{ WaitListData{ nullptr, 0 } }
+{}
+/**
+ * @brief wait until predicate() becomes true
+ * @param lock locked Mutex protecting predicate state
+ * @param predicate condition to wait for
+ */
+template<typename Predicate>
+void ConditionVariable::wait( std::unique_lock<Mutex>& lock, Predicate predicate )
+{
+    while( !predicate() )
+    {
+        wait( lock );
+    }
+}
+
+}
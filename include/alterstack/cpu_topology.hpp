@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct hwloc_topology;
+
+namespace alterstack
+{
+/**
+ * @brief CPU cores and caches topology of current machine
+ *
+ * With ALTERSTACK_USE_HWLOC topology is detected by hwloc: physical cores,
+ * shared L2/L3 caches and NUMA nodes. Without hwloc each CPU available to
+ * process is a separate core, no shared caches and single NUMA node.
+ *
+ * Cores are numbered [0, core_count()), CPUs are OS CPU indexes, NUMA nodes
+ * are numbered [0, numa_node_count()).
+ *
+ * With hwloc topology is kept loaded to bind memory to NUMA node (bind_memory()).
+ */
+class CpuTopology
+{
+public:
+    /// distance between cores (less is closer)
+    enum Distance : uint32_t
+    {
+        SameCore     = 0,
+        SharedL2     = 1,
+        SharedL3     = 2,
+        SameNumaNode = 3,
+        OtherNode    = 4,
+    };
+
+    CpuTopology( const CpuTopology& ) = delete;
+    CpuTopology( CpuTopology&& )      = delete;
+    CpuTopology& operator=( const CpuTopology& ) = delete;
+    CpuTopology& operator=( CpuTopology&& )      = delete;
+
+    static const CpuTopology& instance();
+    ~CpuTopology();
+
+    uint32_t core_count() const noexcept;
+    const std::vector<uint32_t>& core_cpus( uint32_t core ) const noexcept;
+    uint32_t numa_node( uint32_t core ) const noexcept;
+    uint32_t numa_node_count() const noexcept;
+    uint32_t cpu_numa_node( uint32_t cpu ) const noexcept;
+    uint32_t current_numa_node() const noexcept;
+    Distance distance( uint32_t core_a, uint32_t core_b ) const noexcept;
+    bool is_detected() const noexcept;
+
+    bool bind_current_thread( uint32_t core ) const noexcept;
+    bool bind_current_thread_to_node( uint32_t node ) const noexcept;
+    bool bind_memory( void* address, size_t size, uint32_t node ) const noexcept;
+
+private:
+    CpuTopology();
+    bool detect_hwloc();
+    void detect_flat();
+
+    struct Core
+    {
+        std::vector<uint32_t> cpus;  ///< OS CPU indexes (hyperthreads)
+        int32_t  l2_cache = -1;      ///< L2 cache id or -1 if not shared/unknown
+        int32_t  l3_cache = -1;      ///< L3 cache id or -1 if not shared/unknown
+        uint32_t numa_node = 0;
+    };
+    std::vector<Core>     m_cores;
+    std::vector<uint32_t> m_cpu_nodes;   ///< NUMA node of OS CPU index
+    uint32_t m_numa_node_count = 1;
+    bool     m_is_detected = false;  ///< topology detected by hwloc
+    hwloc_topology* m_hwloc = nullptr; ///< loaded hwloc topology or nullptr
+};
+
+inline uint32_t CpuTopology::core_count() const noexcept
+{
+    return static_cast<uint32_t>( m_cores.size() );
+}
+
+inline const std::vector<uint32_t>& CpuTopology::core_cpus( uint32_t core ) const noexcept
+{
+    return m_cores[ core ].cpus;
+}
+
+inline uint32_t CpuTopology::numa_node( uint32_t core ) const noexcept
+{
+    return m_cores[ core ].numa_node;
+}
+
+inline uint32_t CpuTopology::numa_node_count() const noexcept
+{
+    return m_numa_node_count;
+}
+
+/**
+ * @brief get NUMA node of OS CPU
+ * @param cpu OS CPU index
+ * @return NUMA node (0 for unknown CPU)
+ */
+inline uint32_t CpuTopology::cpu_numa_node( uint32_t cpu ) const noexcept
+{
+    return cpu < m_cpu_nodes.size() ? m_cpu_nodes[ cpu ] : 0;
+}
+
+inline bool CpuTopology::is_detected() const noexcept
+{
+    return m_is_detected;
+}
+
+}
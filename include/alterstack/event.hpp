@@ -0,0 +1,67 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "alterstack/awaitable.hpp"
+
+namespace alterstack
+{
+class TaskBase;
+/**
+ * @brief resettable Awaitable, wait point reusable without new object
+ *
+ * Uses the same 16 byte AwaitableData word as Awaitable: is_finished means
+ * Event is set, head is wait list top (always empty while Event is set).
+ *
+ * wait() returns at once if Event is set, else parks current Task in wait list.
+ * set() marks Event set and wakes up all Tasks in wait list by one CAS.
+ * reset() returns set Event to not set state, new wait() will park again.
+ * Tasks woken up by set() return from wait() even if Event was reset after.
+ *
+ * wait(), set() and reset() are lock free and threadsafe
+ */
+class Event
+{
+public:
+    explicit Event( bool is_set = false ) noexcept;
+    ~Event();
+
+    Event( const Event& ) = delete;
+    Event( Event&& )      = delete;
+    Event& operator=( const Event& ) = delete;
+    Event& operator=( Event&& )      = delete;
+
+    void wait();
+    void set() noexcept;
+    void reset() noexcept;
+    bool is_set() const noexcept;
+
+private:
+    ::std::atomic<Awaitable::AwaitableData> m_data; ///< is_finished - Event is set, head - wait list
+};
+
+inline bool Event::is_set() const noexcept
+{
+    return m_data.load( std::memory_order_acquire ).is_finished;
+}
+
+}
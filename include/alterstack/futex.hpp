@@ -23,9 +23,12 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <cerrno>
 #include <climits>
+#include <ctime>
 
 #include <atomic>
+#include <chrono>
 /**
  * @brief implements wait() and notify() for OS thread in lockfree way
  *
@@ -83,6 +86,7 @@ public:
     ~Futex() = default;
 
     void wait();
+    bool wait_for( std::chrono::nanoseconds timeout );
     void notify(int32_t count = 1) noexcept;
     void notify_all();
 
@@ -117,6 +121,32 @@ inline void Futex::wait()
 
     return;
 }
+/**
+ * @brief wait on futex no longer than timeout
+ *
+ * Same as wait(), but returns after timeout even if nobody called notify().
+ * @param timeout max time to sleep
+ * @return false if timeout expired, true if woken up (or had work)
+ */
+inline bool Futex::wait_for( std::chrono::nanoseconds timeout )
+{
+    bool have_work = m_work_avalable.load(std::memory_order_acquire);
+    if( have_work != 0 )
+    {
+        have_work = m_work_avalable.exchange( 0, std::memory_order_release );
+        if( have_work != 0 )
+            return true;
+    }
+    struct timespec relative_timeout;
+    relative_timeout.tv_sec  = static_cast<time_t>( timeout.count() / 1000000000 );
+    relative_timeout.tv_nsec = static_cast<long>( timeout.count() % 1000000000 );
+    m_wait_counter.fetch_add( 1, std::memory_order_relaxed);
+    long res = syscall(SYS_futex, &m_work_avalable, FUTEX_WAIT, 0, &relative_timeout, NULL, 0 );
+    int error = errno;
+    m_wait_counter.fetch_sub( 1, std::memory_order_release );
+
+    return !( res == -1 && error == ETIMEDOUT );
+}
 /**
  * @brief wake up thread waiting on this futex if there is some
  *
@@ -0,0 +1,583 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "alterstack/awaitable.hpp"
+#include "alterstack/task.hpp"
+
+namespace alterstack
+{
+template<typename T>
+class Future;
+template<typename T>
+class Promise;
+/**
+ * @brief result type of async( runnable )
+ */
+template<typename Callable>
+using AsyncResult = typename std::result_of<typename std::decay<Callable>::type&()>::type;
+
+template<typename Callable>
+Future<AsyncResult<Callable>> async( Callable&& runnable, const TaskOptions& options = TaskOptions{} );
+/**
+ * @brief storage of Future value, empty for void
+ */
+template<typename T>
+class FutureValue
+{
+public:
+    FutureValue() = default;
+    FutureValue( const FutureValue& ) = delete;
+    FutureValue& operator=( const FutureValue& ) = delete;
+    ~FutureValue();
+
+    template<typename... Args>
+    void emplace( Args&&... args );
+    T take();
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+    bool m_has_value = false;
+};
+
+template<>
+class FutureValue<void>
+{
+public:
+    void emplace() noexcept
+    {}
+    void take() noexcept
+    {}
+};
+/**
+ * @brief state shared by Promise (or async() Task) and Future
+ *
+ * Holds value or exception inline and Awaitable released when result is set,
+ * so Future::get() parks current Task instead of blocking OS thread.
+ * State created by Promise is reference counted heap object, async() places
+ * it at the Stack top of its Task (Task::spawn_with_state()).
+ */
+template<typename T>
+class FutureState
+{
+public:
+    FutureState() = default;
+    FutureState( const FutureState& ) = delete;
+    FutureState& operator=( const FutureState& ) = delete;
+
+    template<typename... Args>
+    void set_value( Args&&... args );
+    void set_exception( std::exception_ptr exception );
+    bool try_set_exception( std::exception_ptr exception ) noexcept;
+    template<typename Callable>
+    void set_result_of( Callable& runnable ) noexcept;
+    bool is_set() const noexcept;
+    bool is_ready() const noexcept;
+    void wait();
+    T get();
+
+    void add_ref() noexcept;
+    void release_ref() noexcept;
+
+private:
+    void start_set();
+    void finish_set() noexcept;
+    template<typename Callable>
+    void set_result_of( Callable& runnable, std::true_type is_void );
+    template<typename Callable>
+    void set_result_of( Callable& runnable, std::false_type is_void );
+
+    Awaitable              m_ready;
+    std::atomic<bool>      m_is_set{ false };   ///< result is being set (or already set)
+    std::atomic<bool>      m_is_ready{ false }; ///< result is set, get() will not wait
+    std::exception_ptr     m_exception;
+    FutureValue<T>         m_value;
+    std::atomic<uint32_t>  m_ref_count{ 1 };    ///< heap state owners (Promise, Future)
+};
+/**
+ * @brief result of Promise or async() Task, get() parks current Task until it is ready
+ *
+ * get() returns value or rethrows exception set by Promise (or thrown by
+ * async() runnable). Future is movable only, get() can be called once.
+ */
+template<typename T>
+class Future
+{
+public:
+    Future() noexcept = default;
+    Future( Future&& other ) noexcept;
+    Future& operator=( Future&& other ) noexcept;
+    ~Future();
+
+    Future( const Future& ) = delete;
+    Future& operator=( const Future& ) = delete;
+
+    T get();
+    void wait() const;
+    bool is_ready() const noexcept;
+    bool valid() const noexcept;
+
+private:
+    explicit Future( FutureState<T>* state ) noexcept;
+    Future( FutureState<T>* state, TaskHandle task ) noexcept;
+    void reset() noexcept;
+
+    FutureState<T>* m_state = nullptr;
+    TaskHandle      m_task; ///< async() Task holding m_state on its Stack
+
+    friend class Promise<T>;
+    template<typename Callable>
+    friend Future<AsyncResult<Callable>> async( Callable&& runnable, const TaskOptions& options );
+};
+/**
+ * @brief producer side of Future
+ *
+ * Promise destroyed without result set stores std::future_error
+ * (broken_promise) to its Future.
+ */
+template<typename T>
+class Promise
+{
+public:
+    Promise();
+    Promise( Promise&& other ) noexcept;
+    Promise& operator=( Promise&& other ) noexcept;
+    ~Promise();
+
+    Promise( const Promise& ) = delete;
+    Promise& operator=( const Promise& ) = delete;
+
+    Future<T> get_future();
+    template<typename... Args>
+    void set_value( Args&&... args );
+    void set_exception( std::exception_ptr exception );
+
+private:
+    void reset() noexcept;
+
+    FutureState<T>* m_state;
+    bool m_is_future_retrieved = false;
+};
+/**
+ * @brief start runnable in new Task and get Future of its result
+ *
+ * Result (or thrown exception) is stored in state placed at Task Stack top,
+ * so no memory is allocated except Task Stack. Future destructor waits Task
+ * finished.
+ * @param runnable R() function or functor to start
+ * @param options Task options
+ * @return Future<R>
+ */
+template<typename Callable>
+Future<AsyncResult<Callable>> async( Callable&& runnable, const TaskOptions& options )
+{
+    using Result = AsyncResult<Callable>;
+    FutureState<Result>* state = nullptr;
+    TaskHandle task = Task::spawn_with_state(
+                [function = std::forward<Callable>( runnable )]( FutureState<Result>& result ) mutable
+                {
+                    result.set_result_of( function );
+                }
+                ,state, options );
+    return Future<Result>( state, std::move( task ) );
+}
+
+template<typename T>
+FutureValue<T>::~FutureValue()
+{
+    if( m_has_value )
+    {
+        reinterpret_cast<T*>( &m_storage )->~T();
+    }
+}
+
+template<typename T>
+template<typename... Args>
+void FutureValue<T>::emplace( Args&&... args )
+{
+    new( &m_storage ) T( std::forward<Args>( args )... );
+    m_has_value = true;
+}
+
+template<typename T>
+T FutureValue<T>::take()
+{
+    return std::move( *reinterpret_cast<T*>( &m_storage ) );
+}
+/**
+ * @brief store value and wake up waiting Tasks
+ * @throw std::future_error if result already set
+ */
+template<typename T>
+template<typename... Args>
+void FutureState<T>::set_value( Args&&... args )
+{
+    start_set();
+    try
+    {
+        m_value.emplace( std::forward<Args>( args )... );
+    }
+    catch( ... )
+    {
+        m_exception = std::current_exception();
+    }
+    finish_set();
+}
+/**
+ * @brief store exception and wake up waiting Tasks
+ * @throw std::future_error if result already set
+ */
+template<typename T>
+void FutureState<T>::set_exception( std::exception_ptr exception )
+{
+    start_set();
+    m_exception = std::move( exception );
+    finish_set();
+}
+/**
+ * @brief store exception if result is not set yet
+ * @param exception exception to store
+ * @return false if result already set (or being set) by other thread
+ */
+template<typename T>
+bool FutureState<T>::try_set_exception( std::exception_ptr exception ) noexcept
+{
+    if( m_is_set.exchange( true, std::memory_order_relaxed ) )
+    {
+        return false;
+    }
+    m_exception = std::move( exception );
+    finish_set();
+    return true;
+}
+/**
+ * @brief call runnable and store its result or thrown exception
+ * @param runnable R() function or functor
+ */
+template<typename T>
+template<typename Callable>
+void FutureState<T>::set_result_of( Callable& runnable ) noexcept
+{
+    try
+    {
+        set_result_of( runnable, std::is_void<T>{} );
+    }
+    catch( ... )
+    {
+        set_exception( std::current_exception() );
+    }
+}
+
+template<typename T>
+template<typename Callable>
+void FutureState<T>::set_result_of( Callable& runnable, std::true_type )
+{
+    runnable();
+    set_value();
+}
+
+template<typename T>
+template<typename Callable>
+void FutureState<T>::set_result_of( Callable& runnable, std::false_type )
+{
+    set_value( runnable() );
+}
+
+template<typename T>
+bool FutureState<T>::is_set() const noexcept
+{
+    return m_is_set.load( std::memory_order_relaxed );
+}
+
+template<typename T>
+bool FutureState<T>::is_ready() const noexcept
+{
+    return m_is_ready.load( std::memory_order_acquire );
+}
+/**
+ * @brief park current Task until result is set
+ */
+template<typename T>
+void FutureState<T>::wait()
+{
+    if( !is_ready() )
+    {
+        m_ready.wait();
+    }
+}
+/**
+ * @brief wait result and take it
+ * @return value
+ * @throw exception stored in state
+ */
+template<typename T>
+T FutureState<T>::get()
+{
+    wait();
+    if( m_exception )
+    {
+        std::rethrow_exception( m_exception );
+    }
+    return m_value.take();
+}
+
+template<typename T>
+void FutureState<T>::add_ref() noexcept
+{
+    m_ref_count.fetch_add( 1, std::memory_order_relaxed );
+}
+
+template<typename T>
+void FutureState<T>::release_ref() noexcept
+{
+    if( m_ref_count.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    {
+        delete this;
+    }
+}
+
+template<typename T>
+void FutureState<T>::start_set()
+{
+    if( m_is_set.exchange( true, std::memory_order_relaxed ) )
+    {
+        throw std::future_error( std::future_errc::promise_already_satisfied );
+    }
+}
+
+template<typename T>
+void FutureState<T>::finish_set() noexcept
+{
+    m_is_ready.store( true, std::memory_order_release );
+    m_ready.release();
+}
+
+template<typename T>
+Future<T>::Future( FutureState<T>* state ) noexcept
+    :m_state{ state }
+{}
+
+template<typename T>
+Future<T>::Future( FutureState<T>* state, TaskHandle task ) noexcept
+    :m_state{ state }
+    ,m_task{ std::move( task ) }
+{}
+
+template<typename T>
+Future<T>::Future( Future&& other ) noexcept
+    :m_state{ other.m_state }
+    ,m_task{ std::move( other.m_task ) }
+{
+    other.m_state = nullptr;
+}
+
+template<typename T>
+Future<T>& Future<T>::operator=( Future&& other ) noexcept
+{
+    if( this != &other )
+    {
+        reset();
+        m_state = other.m_state;
+        m_task  = std::move( other.m_task );
+        other.m_state = nullptr;
+    }
+    return *this;
+}
+
+template<typename T>
+Future<T>::~Future()
+{
+    reset();
+}
+/**
+ * @brief park current Task until result is ready and take it
+ *
+ * Future becomes invalid after get().
+ * @return value
+ * @throw exception set by Promise or thrown by async() runnable,
+ * std::future_error if Future is not valid
+ */
+template<typename T>
+T Future<T>::get()
+{
+    if( m_state == nullptr )
+    {
+        throw std::future_error( std::future_errc::no_state );
+    }
+    struct ResetGuard
+    {
+        ~ResetGuard()
+        {
+            future->reset();
+        }
+        Future* future;
+    } guard{ this };
+    return m_state->get();
+}
+/**
+ * @brief park current Task until result is ready
+ */
+template<typename T>
+void Future<T>::wait() const
+{
+    if( m_state != nullptr )
+    {
+        m_state->wait();
+    }
+}
+
+template<typename T>
+bool Future<T>::is_ready() const noexcept
+{
+    return m_state != nullptr && m_state->is_ready();
+}
+
+template<typename T>
+bool Future<T>::valid() const noexcept
+{
+    return m_state != nullptr;
+}
+/**
+ * @brief release state, waits async() Task finished
+ */
+template<typename T>
+void Future<T>::reset() noexcept
+{
+    if( m_state == nullptr )
+    {
+        return;
+    }
+    if( m_task )
+    {
+        m_task->join();
+        m_state->~FutureState<T>();
+        m_task.reset();
+    }
+    else
+    {
+        m_state->release_ref();
+    }
+    m_state = nullptr;
+}
+
+template<typename T>
+Promise<T>::Promise()
+    :m_state{ new FutureState<T>() }
+{}
+
+template<typename T>
+Promise<T>::Promise( Promise&& other ) noexcept
+    :m_state{ other.m_state }
+    ,m_is_future_retrieved{ other.m_is_future_retrieved }
+{
+    other.m_state = nullptr;
+}
+
+template<typename T>
+Promise<T>& Promise<T>::operator=( Promise&& other ) noexcept
+{
+    if( this != &other )
+    {
+        reset();
+        m_state = other.m_state;
+        m_is_future_retrieved = other.m_is_future_retrieved;
+        other.m_state = nullptr;
+    }
+    return *this;
+}
+
+template<typename T>
+Promise<T>::~Promise()
+{
+    reset();
+}
+/**
+ * @brief get Future sharing state with this Promise, can be called once
+ * @return Future<T>
+ * @throw std::future_error if Future already retrieved or Promise moved out
+ */
+template<typename T>
+Future<T> Promise<T>::get_future()
+{
+    if( m_state == nullptr )
+    {
+        throw std::future_error( std::future_errc::no_state );
+    }
+    if( m_is_future_retrieved )
+    {
+        throw std::future_error( std::future_errc::future_already_retrieved );
+    }
+    m_is_future_retrieved = true;
+    m_state->add_ref();
+    return Future<T>( m_state );
+}
+/**
+ * @brief store value and wake up Tasks waiting Future
+ * @throw std::future_error if result already set or Promise moved out
+ */
+template<typename T>
+template<typename... Args>
+void Promise<T>::set_value( Args&&... args )
+{
+    if( m_state == nullptr )
+    {
+        throw std::future_error( std::future_errc::no_state );
+    }
+    m_state->set_value( std::forward<Args>( args )... );
+}
+/**
+ * @brief store exception and wake up Tasks waiting Future
+ * @throw std::future_error if result already set or Promise moved out
+ */
+template<typename T>
+void Promise<T>::set_exception( std::exception_ptr exception )
+{
+    if( m_state == nullptr )
+    {
+        throw std::future_error( std::future_errc::no_state );
+    }
+    m_state->set_exception( std::move( exception ) );
+}
+
+template<typename T>
+void Promise<T>::reset() noexcept
+{
+    if( m_state == nullptr )
+    {
+        return;
+    }
+    // set_value() racing with destruction may win after is_set() check
+    if( !m_state->is_set() )
+    {
+        m_state->try_set_exception( std::make_exception_ptr(
+                                        std::future_error( std::future_errc::broken_promise ) ) );
+    }
+    m_state->release_ref();
+    m_state = nullptr;
+}
+
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "spin_lock.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief MPMC queue: lock free bounded ring with SpinLock protected overflow list
+ *
+ * T item MUST have next() and set_next() methods (to make intrusive list)
+ *
+ * Ring is Dmitry Vyukov's bounded MPMC queue: each cell has sequence number,
+ * producer owns cell when sequence == enqueue position, consumer when
+ * sequence == dequeue position + 1, so put and get are single CAS on
+ * position without ABA problem.
+ *
+ * Ring never rejects item: when it is full items go to SpinLock protected
+ * overflow FIFO list, and while overflow list is not empty new items go there
+ * too (get_item() takes ring items first). Overflow items are never moved
+ * back to ring, so after overflow under sustained load every put_item() takes
+ * overflow lock until the list drains: queue is lock free only while ring
+ * is not full.
+ * Producer falling back to overflow list re-checks ring under overflow lock,
+ * so overflow list is started only if ring is still full. The only exception
+ * is ring to overflow transition: producer which saw empty overflow list
+ * before concurrent put_item() started it can still store its item in ring
+ * (freed by consumer) after overflow item, so order of put_item() calls
+ * overlapping in time with this transition is approximate.
+ *
+ * Priority argument of put_item() is ignored (all items are in one FIFO).
+ *
+ * T* get_item( bool& have_more_items ) noexcept; dequeue single T* item
+ * from queue if exists or return nullptr
+ *
+ * T* get_item_except( uint32_t level, bool& have_more_items ) noexcept;
+ * always nullptr (there are no levels, caller serves its own queue)
+ *
+ * bool has_items_except( uint32_t level ) const noexcept; always false
+ *
+ * void put_item( T* item, uint32_t prio ) noexcept; enqueue single T* item
+ */
+template<typename T, size_t CAPACITY = 512>
+class alignas(64) MpmcRingQueue
+{
+public:
+    MpmcRingQueue() noexcept;
+
+    MpmcRingQueue( const MpmcRingQueue& ) = delete;
+    MpmcRingQueue( MpmcRingQueue&& )      = delete;
+    MpmcRingQueue& operator=( const MpmcRingQueue& ) = delete;
+    MpmcRingQueue& operator=( MpmcRingQueue&& )      = delete;
+
+    T*     get_item( bool& have_more_items ) noexcept;
+    T*     get_item_except( uint32_t level, bool& have_more_items ) noexcept;
+    bool   has_items_except( uint32_t level ) const noexcept;
+    void   put_item( T* item, uint32_t prio ) noexcept;
+    size_t depth( uint32_t prio ) const noexcept;
+
+private:
+    static_assert( CAPACITY >= 2 && ( CAPACITY & ( CAPACITY - 1 ) ) == 0
+                   ,"CAPACITY MUST be power of 2" );
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T*                  item;
+    };
+
+    bool try_push( T* item ) noexcept;
+    T*   try_pop() noexcept;
+    void push_overflow( T* item ) noexcept;
+    T*   pop_overflow() noexcept;
+
+    Cell                m_cells[ CAPACITY ];
+    alignas(64)
+    std::atomic<size_t> m_enqueue_pos{ 0 };
+    alignas(64)
+    std::atomic<size_t> m_dequeue_pos{ 0 };
+    alignas(64)
+    SpinLock            m_overflow_lock;
+    T*                  m_overflow_head = nullptr;
+    T*                  m_overflow_tail = nullptr;
+    std::atomic<size_t> m_overflow_depth{ 0 };
+};
+
+template<typename T, size_t CAPACITY>
+MpmcRingQueue<T, CAPACITY>::MpmcRingQueue() noexcept
+{
+    for( size_t i = 0; i < CAPACITY; ++i )
+    {
+        m_cells[i].sequence.store( i, std::memory_order_relaxed );
+        m_cells[i].item = nullptr;
+    }
+}
+/**
+ * @brief dequeue T* item or nullptr
+ *
+ * @param have_more_items will set this flag to true, if there is more items
+ * (can be false negative under concurrent put_item())
+ * @return single T* item (not list) or nullptr if queue is empty
+ */
+template<typename T, size_t CAPACITY>
+T* MpmcRingQueue<T, CAPACITY>::get_item( bool& have_more_items ) noexcept
+{
+    T* item = try_pop();
+    if( item == nullptr )
+    {
+        item = pop_overflow();
+    }
+    if( item != nullptr
+            && depth( 0 ) != 0 )
+    {
+        have_more_items = true;
+    }
+    return item;
+}
+/**
+ * @brief dequeue T* item of level other than given one
+ *
+ * Queue has single FIFO for all priorities, so there are no other levels.
+ * @return nullptr
+ */
+template<typename T, size_t CAPACITY>
+T* MpmcRingQueue<T, CAPACITY>::get_item_except( uint32_t, bool& ) noexcept
+{
+    return nullptr;
+}
+/**
+ * @brief check if levels other than given one have items
+ * @return false (there are no levels)
+ */
+template<typename T, size_t CAPACITY>
+inline bool MpmcRingQueue<T, CAPACITY>::has_items_except( uint32_t ) const noexcept
+{
+    return false;
+}
+/**
+ * @brief enqueue single T* item at the end of queue
+ *
+ * @param item T* to store
+ * @param prio ignored
+ */
+template<typename T, size_t CAPACITY>
+void MpmcRingQueue<T, CAPACITY>::put_item( T* item, uint32_t ) noexcept
+{
+    if( m_overflow_depth.load( std::memory_order_acquire ) != 0
+            || !try_push( item ) )
+    {
+        push_overflow( item );
+    }
+}
+/**
+ * @brief get number of items in queue
+ * @param prio ignored (all items are in one FIFO)
+ * @return items count (approximate under concurrent access)
+ */
+template<typename T, size_t CAPACITY>
+size_t MpmcRingQueue<T, CAPACITY>::depth( uint32_t ) const noexcept
+{
+    const size_t enqueue_pos = m_enqueue_pos.load( std::memory_order_relaxed );
+    const size_t dequeue_pos = m_dequeue_pos.load( std::memory_order_relaxed );
+    const size_t ring_depth  = ( enqueue_pos > dequeue_pos ) ? enqueue_pos - dequeue_pos : 0;
+    return ring_depth + m_overflow_depth.load( std::memory_order_relaxed );
+}
+/**
+ * @brief store item in ring
+ * @param item T* to store
+ * @return false if ring is full
+ */
+template<typename T, size_t CAPACITY>
+bool MpmcRingQueue<T, CAPACITY>::try_push( T* item ) noexcept
+{
+    Cell* cell;
+    size_t pos = m_enqueue_pos.load( std::memory_order_relaxed );
+    while( true )
+    {
+        cell = &m_cells[ pos & MASK ];
+        const size_t sequence = cell->sequence.load( std::memory_order_acquire );
+        const intptr_t diff = static_cast<intptr_t>( sequence ) - static_cast<intptr_t>( pos );
+        if( diff == 0 )
+        {
+            if( m_enqueue_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if( diff < 0 )
+        {
+            return false; // cell still has item from previous lap
+        }
+        else
+        {
+            pos = m_enqueue_pos.load( std::memory_order_relaxed );
+        }
+    }
+    cell->item = item;
+    cell->sequence.store( pos + 1, std::memory_order_release );
+    return true;
+}
+/**
+ * @brief get item from ring
+ * @return T* or nullptr if ring is empty
+ */
+template<typename T, size_t CAPACITY>
+T* MpmcRingQueue<T, CAPACITY>::try_pop() noexcept
+{
+    Cell* cell;
+    size_t pos = m_dequeue_pos.load( std::memory_order_relaxed );
+    while( true )
+    {
+        cell = &m_cells[ pos & MASK ];
+        const size_t sequence = cell->sequence.load( std::memory_order_acquire );
+        const intptr_t diff = static_cast<intptr_t>( sequence ) - static_cast<intptr_t>( pos + 1 );
+        if( diff == 0 )
+        {
+            if( m_dequeue_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if( diff < 0 )
+        {
+            return nullptr; // cell is not filled yet
+        }
+        else
+        {
+            pos = m_dequeue_pos.load( std::memory_order_relaxed );
+        }
+    }
+    T* item = cell->item;
+    cell->sequence.store( pos + MASK + 1, std::memory_order_release );
+    return item;
+}
+
+/**
+ * @brief store item in overflow list (or in ring if it is not full already)
+ *
+ * Ring could be drained by consumers while waiting for m_overflow_lock, then
+ * item goes to ring and overflow list stays empty.
+ * @param item T* to store
+ */
+template<typename T, size_t CAPACITY>
+void MpmcRingQueue<T, CAPACITY>::push_overflow( T* item ) noexcept
+{
+    item->set_next( nullptr );
+    std::lock_guard<SpinLock> lock( m_overflow_lock );
+    if( m_overflow_tail == nullptr )
+    {
+        if( try_push( item ) )
+        {
+            return;
+        }
+        m_overflow_head = item;
+    }
+    else
+    {
+        m_overflow_tail->set_next( item );
+    }
+    m_overflow_tail = item;
+    m_overflow_depth.fetch_add( 1, std::memory_order_release );
+}
+
+template<typename T, size_t CAPACITY>
+T* MpmcRingQueue<T, CAPACITY>::pop_overflow() noexcept
+{
+    if( m_overflow_depth.load( std::memory_order_acquire ) == 0 )
+    {
+        return nullptr;
+    }
+    std::lock_guard<SpinLock> lock( m_overflow_lock );
+    T* item = m_overflow_head;
+    if( item == nullptr )
+    {
+        return nullptr;
+    }
+    m_overflow_head = item->next();
+    if( m_overflow_head == nullptr )
+    {
+        m_overflow_tail = nullptr;
+    }
+    item->set_next( nullptr );
+    m_overflow_depth.fetch_sub( 1, std::memory_order_release );
+    return item;
+}
+
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "spin_lock.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief Multi level FIFO queue with weighted selection between levels
+ *
+ * T item MUST have next() and set_next() methods (to make intrusive list)
+ *
+ * Each level (priority, 0 is the highest) is separate FIFO intrusive list
+ * protected by it's own SpinLock. get_item() selects level by weighted round
+ * robin: level i has weight 2^(LEVEL_COUNT - 1 - i) slots in each
+ * WEIGHT_PERIOD dequeues (8, 4, 2, 1 for 4 levels). If preferred level is
+ * empty, levels are checked from the highest. So lowest level gets at
+ * least 1/WEIGHT_PERIOD of dequeues and can not starve, while higher levels
+ * get most of them.
+ *
+ * Level locks are short (few pointer stores) and uncontended in common case:
+ * producers and consumers of different priorities use different levels.
+ * LockFreeQueue gives no ordering at all, while SpinLock keeps strict FIFO
+ * order inside level, and get_item() skips empty levels by relaxed depth
+ * load without touching their lock.
+ *
+ * depth() is approximate (relaxed) number of items in level.
+ *
+ * T* get_item_except( uint32_t level, bool& have_more_items ) noexcept;
+ * same as get_item(), but never takes items of level, returns nullptr
+ * when weighted round robin turn belongs to it (caller serves level from
+ * its own queue)
+ *
+ * bool has_items_except( uint32_t level ) const noexcept; relaxed depth check
+ * of other levels, no lock and no shared write, to gate get_item_except()
+ *
+ * T* get_item( bool& have_more_items ) noexcept; dequeue single T* item
+ * from queue if exists or return nullptr
+ *
+ * void put_item( T* item, uint32_t prio ) noexcept; enqueue single T* item
+ * at the end of level prio (clamped to the lowest level)
+ */
+template<typename T, uint32_t LEVEL_COUNT = 4>
+class alignas(64) MultiLevelQueue
+{
+public:
+    MultiLevelQueue() = default;
+
+    MultiLevelQueue( const MultiLevelQueue& ) = delete;
+    MultiLevelQueue( MultiLevelQueue&& )      = delete;
+    MultiLevelQueue& operator=( const MultiLevelQueue& ) = delete;
+    MultiLevelQueue& operator=( MultiLevelQueue&& )      = delete;
+
+    T*     get_item( bool& have_more_items ) noexcept;
+    T*     get_item_except( uint32_t level, bool& have_more_items ) noexcept;
+    bool   has_items_except( uint32_t level ) const noexcept;
+    void   put_item( T* item, uint32_t prio ) noexcept;
+    size_t depth( uint32_t prio ) const noexcept;
+
+    /// dequeues in one weighted round robin period
+    static constexpr uint32_t WEIGHT_PERIOD = ( 1u << LEVEL_COUNT ) - 1;
+
+private:
+    static_assert( LEVEL_COUNT > 0 && LEVEL_COUNT < 16, "LEVEL_COUNT MUST be in [1, 15]" );
+
+    struct alignas(64) Level
+    {
+        SpinLock            lock;
+        T*                  head = nullptr;
+        T*                  tail = nullptr;
+        std::atomic<size_t> depth{ 0 };
+    };
+
+    static uint32_t preferred_level( uint32_t tick ) noexcept;
+    T* pop( Level& level ) noexcept;
+    bool has_items() const noexcept;
+
+    Level                 m_levels[ LEVEL_COUNT ];
+    std::atomic<uint32_t> m_tick{ 0 }; ///< dequeues counter for weighted selection
+};
+
+/**
+ * @brief dequeue T* item or nullptr
+ *
+ * @param have_more_items will set this flag to true, if there is more items
+ * (can be false negative under concurrent put_item())
+ * @return single T* item (not list) or nullptr if queue is empty
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+T* MultiLevelQueue<T, LEVEL_COUNT>::get_item( bool& have_more_items ) noexcept
+{
+    const uint32_t tick = m_tick.fetch_add( 1, std::memory_order_relaxed );
+    const uint32_t preferred = preferred_level( tick % WEIGHT_PERIOD );
+    T* item = pop( m_levels[ preferred ] );
+    for( uint32_t i = 0; i < LEVEL_COUNT && item == nullptr; ++i )
+    {
+        if( i != preferred )
+        {
+            item = pop( m_levels[ i ] );
+        }
+    }
+    if( item != nullptr
+            && has_items() )
+    {
+        have_more_items = true;
+    }
+    return item;
+}
+/**
+ * @brief dequeue T* item of any level except one or nullptr
+ *
+ * Level is treated as served by caller: if it is preferred by weighted
+ * round robin nullptr is returned. Caller on hot path SHOULD check
+ * has_items_except() first, get_item_except() advances shared tick.
+ * @param level level to skip
+ * @param have_more_items will set this flag to true, if there is more items
+ * (can be false negative under concurrent put_item())
+ * @return single T* item (not list) or nullptr
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+T* MultiLevelQueue<T, LEVEL_COUNT>::get_item_except( uint32_t level, bool& have_more_items ) noexcept
+{
+    const uint32_t tick = m_tick.fetch_add( 1, std::memory_order_relaxed );
+    const uint32_t preferred = preferred_level( tick % WEIGHT_PERIOD );
+    if( preferred == level )
+    {
+        return nullptr;
+    }
+    T* item = pop( m_levels[ preferred ] );
+    for( uint32_t i = 0; i < LEVEL_COUNT && item == nullptr; ++i )
+    {
+        if( i != preferred && i != level )
+        {
+            item = pop( m_levels[ i ] );
+        }
+    }
+    if( item != nullptr
+            && has_items() )
+    {
+        have_more_items = true;
+    }
+    return item;
+}
+/**
+ * @brief enqueue single T* item at the end of it's level
+ *
+ * @param item T* to store
+ * @param prio level (0 is the highest priority)
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+void MultiLevelQueue<T, LEVEL_COUNT>::put_item( T* item, uint32_t prio ) noexcept
+{
+    if( prio >= LEVEL_COUNT )
+    {
+        prio = LEVEL_COUNT - 1;
+    }
+    Level& level = m_levels[ prio ];
+    item->set_next( nullptr );
+    std::lock_guard<SpinLock> lock( level.lock );
+    if( level.tail == nullptr )
+    {
+        level.head = item;
+    }
+    else
+    {
+        level.tail->set_next( item );
+    }
+    level.tail = item;
+    level.depth.fetch_add( 1, std::memory_order_relaxed );
+}
+/**
+ * @brief check if levels other than given one have items
+ *
+ * Only relaxed loads of per level depth counters (each on own cache line,
+ * written by producers and consumers of that level only).
+ * @param level level to skip
+ * @return true if other levels are not empty (approximate)
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+inline bool MultiLevelQueue<T, LEVEL_COUNT>::has_items_except( uint32_t level ) const noexcept
+{
+    for( uint32_t i = 0; i < LEVEL_COUNT; ++i )
+    {
+        if( i != level
+                && m_levels[ i ].depth.load( std::memory_order_relaxed ) != 0 )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+/**
+ * @brief get number of items in level
+ * @param prio level
+ * @return items count (approximate under concurrent access)
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+size_t MultiLevelQueue<T, LEVEL_COUNT>::depth( uint32_t prio ) const noexcept
+{
+    if( prio >= LEVEL_COUNT )
+    {
+        prio = LEVEL_COUNT - 1;
+    }
+    return m_levels[ prio ].depth.load( std::memory_order_relaxed );
+}
+/**
+ * @brief map dequeue tick to level by level weights
+ *
+ * Level i owns 2^(LEVEL_COUNT - 1 - i) consecutive ticks of period.
+ * @param tick tick in [0, WEIGHT_PERIOD)
+ * @return preferred level
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+uint32_t MultiLevelQueue<T, LEVEL_COUNT>::preferred_level( uint32_t tick ) noexcept
+{
+    uint32_t slots = 1u << ( LEVEL_COUNT - 1 );
+    uint32_t level = 0;
+    while( tick >= slots && level + 1 < LEVEL_COUNT )
+    {
+        tick  -= slots;
+        slots >>= 1;
+        ++level;
+    }
+    return level;
+}
+/**
+ * @brief remove first item of level
+ * @param level level to pop from
+ * @return T* or nullptr if level is empty
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+T* MultiLevelQueue<T, LEVEL_COUNT>::pop( Level& level ) noexcept
+{
+    if( level.depth.load( std::memory_order_relaxed ) == 0 )
+    {
+        return nullptr;
+    }
+    std::lock_guard<SpinLock> lock( level.lock );
+    T* item = level.head;
+    if( item == nullptr )
+    {
+        return nullptr;
+    }
+    level.head = item->next();
+    if( level.head == nullptr )
+    {
+        level.tail = nullptr;
+    }
+    item->set_next( nullptr );
+    level.depth.fetch_sub( 1, std::memory_order_relaxed );
+    return item;
+}
+/**
+ * @brief check if any level has items
+ * @return true if queue is not empty (approximate under concurrent access)
+ */
+template<typename T, uint32_t LEVEL_COUNT>
+bool MultiLevelQueue<T, LEVEL_COUNT>::has_items() const noexcept
+{
+    for( const Level& level: m_levels )
+    {
+        if( level.depth.load( std::memory_order_relaxed ) != 0 )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
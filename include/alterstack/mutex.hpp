@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace alterstack
+{
+class TaskBase;
+/**
+ * @brief Mutex for Task s, parks current Task instead of blocking OS thread
+ *
+ * State is one tagged word: bit 0 - locked flag, other bits - pointer to top
+ * of waiters stack (intrusive list of TaskBase, like Awaitable wait list).
+ *
+ * lock() takes unlocked Mutex by single CAS. Contended lock() spins a bit,
+ * then pushes current Task in waiters stack and switches to next Task
+ * (AlterNative Task) or sleeps on TaskRunner::native_futex (Native Task, thread
+ * bound code). unlock() without waiters clears locked flag by single CAS. With
+ * waiters it keeps Mutex locked and hands it over to the oldest waiter
+ * (Scheduler::add_waiting_list_to_running()): whole waiters stack is taken
+ * by one CAS and reversed to FIFO list owned by Mutex owner, so waiters are
+ * served in lock() order and can not starve (like Semaphore permits).
+ *
+ * Mutex is not recursive, it MUST be unlocked by owner. Satisfies Lockable,
+ * so it works with std::lock_guard and std::unique_lock.
+ *
+ * lock(), try_lock() and unlock() are threadsafe
+ */
+class Mutex
+{
+public:
+    Mutex() = default;
+    ~Mutex();
+
+    Mutex( const Mutex& ) = delete;
+    Mutex( Mutex&& )      = delete;
+    Mutex& operator=( const Mutex& ) = delete;
+    Mutex& operator=( Mutex&& )      = delete;
+
+    void lock();
+    bool try_lock() noexcept;
+    void unlock() noexcept;
+
+private:
+    static constexpr uintptr_t LOCKED = 1;
+    /// lock() attempts before parking current Task
+    static constexpr uint32_t SPIN_COUNT = 64;
+
+    bool try_park( TaskBase* task, uintptr_t state ) noexcept;
+
+    std::atomic<uintptr_t> m_state{ 0 }; ///< LOCKED | waiters stack top
+    TaskBase* m_fifo = nullptr; ///< older waiters in FIFO order, owner only
+};
+/**
+ * @brief try to lock Mutex without waiting
+ * @return true if Mutex locked by this call
+ */
+inline bool Mutex::try_lock() noexcept
+{
+    uintptr_t state = m_state.load( std::memory_order_relaxed );
+    while( ( state & LOCKED ) == 0 )
+    {
+        if( m_state.compare_exchange_weak( state, state | LOCKED
+                                           ,std::memory_order_acquire
+                                           ,std::memory_order_relaxed ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
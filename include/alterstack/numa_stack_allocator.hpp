@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "slab_stack_allocator.hpp"
+#include "stack_allocator.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief StackAllocator with separate node local SlabStackAllocator per NUMA node
+ *
+ * Stack is allocated from slab bound to NUMA node of CPU current thread is
+ * running on, so new Task (which usually runs on the same node, see
+ * Scheduler::set_numa_domains()) touches local memory only. Stack goes back
+ * to its node allocator (Stack::allocator()), so deallocate() of this class
+ * is never called for it's Stack s.
+ *
+ * NumaStackAllocator MUST outlive all Task s using it.
+ *
+ * allocate() and deallocate() are threadsafe
+ */
+class NumaStackAllocator final : public StackAllocator
+{
+public:
+    explicit NumaStackAllocator( size_t slab_size = 64*1024*1024
+                                 ,SlabPages pages = SlabPages::Normal );
+
+    NumaStackAllocator( const NumaStackAllocator& ) = delete;
+    NumaStackAllocator( NumaStackAllocator&& )      = delete;
+    NumaStackAllocator& operator=( const NumaStackAllocator& ) = delete;
+    NumaStackAllocator& operator=( NumaStackAllocator&& )      = delete;
+
+    Stack* allocate( StackSize size_class, StackGuard guard ) override;
+    void   deallocate( Stack* stack ) noexcept override;
+
+    uint32_t node_count() const noexcept;
+    SlabStackAllocator& node_allocator( uint32_t node ) noexcept;
+
+private:
+    std::vector<std::unique_ptr<SlabStackAllocator>> m_node_allocators;
+};
+
+inline uint32_t NumaStackAllocator::node_count() const noexcept
+{
+    return static_cast<uint32_t>( m_node_allocators.size() );
+}
+/**
+ * @brief get SlabStackAllocator of NUMA node
+ * @param node NUMA node index, MUST be less than node_count()
+ * @return node local SlabStackAllocator
+ */
+inline SlabStackAllocator& NumaStackAllocator::node_allocator( uint32_t node ) noexcept
+{
+    return *m_node_allocators[ node ];
+}
+
+}
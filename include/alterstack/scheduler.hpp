@@ -19,61 +19,130 @@
 
 #pragma once
 
-#include "lock_free_queue.hpp"
+#include <atomic>
+#include <memory>
+
+#include "mpmc_ring_queue.hpp"
+#include "multi_level_queue.hpp"
 #include "task_runner.hpp"
 #include "bg_runner.hpp"
 #include "passkey.hpp"
+#include "futex.hpp"
 
 namespace alterstack
 {
 class TaskBase;
-using RunningQueue = LockFreeQueue<TaskBase>;
+class StackAllocator;
+#ifdef ALTERSTACK_FIFO_RUNNING_QUEUE
+using RunningQueue = MpmcRingQueue<TaskBase>;
+#else
+using RunningQueue = MultiLevelQueue<TaskBase, static_cast<uint32_t>(Task::Priority::MaxNum) + 1>;
+#endif
 /**
  * @brief Tasks scheduler.
  *
  * Implements tasks running queue and switching OS threads to next task or
  * waiting on conditional variable if there are no running task.
  *
+ * Process has default Scheduler (instance()) and any number of user created
+ * ones, each with it's own BgRunner, running queues and Stack pool. So latency
+ * critical Task s can be isolated from batch work. Task runs on Scheduler
+ * set in TaskOptions::scheduler (Scheduler of creating BgThread or default
+ * one if not set) and can move to another one by Task::migrate(). Threads
+ * not owned by any BgRunner run Task s of default Scheduler.
+ * User created Scheduler MUST outlive all Task s running on it.
+ *
  * For scheduling aggorithm see Main Page in section @ref scheduling_algorithm.
+ *
+ * With NUMA domains (set_numa_domains()) Scheduler has separate running queue
+ * for each NUMA node (up to MAX_NUMA_DOMAINS), BgThread's are placed on
+ * nodes and look for Task in other domains only if their own domain has no
+ * Task. Stack s are allocated from node local NumaStackAllocator.
  */
 class Scheduler
 {
 private:
-    Scheduler();
+    Scheduler( uint32_t min_spare, uint32_t max_running
+               ,StackAllocator* stack_allocator, bool is_default );
     Scheduler(const Scheduler&) = delete;
     Scheduler(Scheduler&&) = delete;
     Scheduler& operator=(const Scheduler&) = delete;
     Scheduler& operator=(Scheduler&&) = delete;
 
 public:
+    explicit Scheduler( uint32_t min_spare = BgRunner::default_min_spare()
+                        ,uint32_t max_running = BgRunner::default_max_running()
+                        ,StackAllocator* stack_allocator = nullptr );
+    ~Scheduler();
+
+    static Scheduler& instance();
+    static Scheduler& current();
+    bool is_current() const noexcept;
+    StackAllocator* stack_allocator() const noexcept;
+    size_t queue_depth( Task::Priority priority ) const noexcept;
+    uint32_t detached_count() const noexcept;
+    void wait_detached_tasks() noexcept;
+
     static bool schedule( TaskBase* current_task = get_current_task() );
     static void run_new_task( TaskBase *task );
+    static void enqueue_new_task( Task* task ) noexcept;
 
     static void post_jump_fcontext( Passkey<Task>
                                     , ::scontext::transfer_t transfer
                                     , TaskBase* current_task );
     static void add_waiting_list_to_running( Passkey<Awaitable>, TaskBase* task_list ) noexcept;
 
-private:
-    static Scheduler& instance();
+    static void set_numa_domains( bool enable ) noexcept;
+    static bool numa_domains_enabled() noexcept;
 
+private:
     bool do_schedule( TaskBase* current_task );
+    static void consume_wakeup( TaskBase* task ) noexcept;
+    static void prepare_park( TaskBase* task ) noexcept;
+    static void cancel_park( TaskBase* task ) noexcept;
     void do_schedule_new_task(TaskBase *task);
     static void switch_to(TaskBase* new_task );
     static void post_jump_fcontext( ::scontext::transfer_t transfer
                                     ,TaskBase* current_task );
 
+    static TaskBase* find_next_task();
+    static void run_task( TaskBase* task );
     TaskBase* get_next_task( TaskBase* current_task );
+    TaskBase* get_running_from_queues() noexcept;
     TaskBase* get_running_from_queue() noexcept;
+    TaskBase* get_running_from_queue( uint32_t domain ) noexcept;
+    TaskBase* get_not_normal_from_queue( uint32_t domain ) noexcept;
+    TaskBase* get_running_from_other_domains( uint32_t domain ) noexcept;
+    TaskBase* get_running_for_bg_thread( BgThread* thread ) noexcept;
     static TaskBase* get_running_from_native();
     static TaskBase* get_native_task();
     static TaskBase* get_current_task();
 
     static void add_waiting_list_to_running( TaskBase* task_list ) noexcept;
     static void enqueue_unbound_task( Task* task ) noexcept;
-    static void wait_while_context_is_null( std::atomic<Context>* context ) noexcept;
+    static void enqueue_yielded_task( Task* task ) noexcept;
+    bool enqueue_local( Task* task, bool is_next ) noexcept;
+    RunningQueue& current_running_queue() noexcept;
+    uint32_t numa_domain_count() const noexcept;
+    void release_detached() noexcept;
 
-    RunningQueue running_queue_;
+    /// BgThread will check global running queue before local one every N schedule calls
+    static constexpr uint32_t GLOBAL_QUEUE_CHECK_INTERVAL = 61;
+    /// max running queues, NUMA nodes above it share queues (node % MAX_NUMA_DOMAINS)
+    static constexpr uint32_t MAX_NUMA_DOMAINS = 8;
+    /// TaskBase::m_context of Task released while switching out to wait
+    static const Context WAKEUP_PENDING;
+    /// TaskBase::m_context of Task which cancelled park before it was published
+    static const Context PARK_CANCELLED;
+
+    const bool     is_default_;       ///< default Scheduler (instance())
+    const uint32_t domain_count_;     ///< NUMA domains (1 if disabled)
+    RunningQueue running_queues_[ MAX_NUMA_DOMAINS ]; ///< global running queue of each domain
+    std::unique_ptr<StackAllocator> own_stack_allocator_; ///< Stack pool created by Scheduler
+    StackAllocator* const stack_allocator_; ///< nullptr - StackAllocator::default_allocator()
+    std::atomic<uint32_t> detached_count_{ 0 }; ///< detached Tasks not destroyed yet
+    std::atomic<uint32_t> detached_notifiers_{ 0 }; ///< release_detached() calls in progress
+    Futex        detached_futex_;     ///< notified when detached_count_ drops to 0
     BgRunner     bg_runner_;
 
 private:
@@ -81,6 +150,12 @@ private:
     friend class BoundTask;
     friend class Task;
     friend class Awaitable;
+    friend class Mutex;
+    friend class ConditionVariable;
+    friend class Semaphore;
+    friend class Event;
+    template<typename T>
+    friend class Channel;
     friend class BgRunner;
     friend class BgThread;
 };
@@ -98,12 +173,26 @@ inline void Scheduler::add_waiting_list_to_running( Passkey<Awaitable>, TaskBase
 }
 
 /**
- * @brief get Scheduler instance singleton
- * @return Scheduler& singleton instance
+ * @brief detached Tasks of this Scheduler not finished and destroyed yet
+ * @return outstanding detached Task count
+ */
+inline uint32_t Scheduler::detached_count() const noexcept
+{
+    return detached_count_.load( std::memory_order_acquire );
+}
+
+inline uint32_t Scheduler::numa_domain_count() const noexcept
+{
+    return domain_count_;
+}
+/**
+ * @brief get default Scheduler (created at first use)
+ * @return Scheduler& default instance
  */
 inline Scheduler& Scheduler::instance()
 {
-    static Scheduler scheduler;
+    static Scheduler scheduler( BgRunner::default_min_spare(), BgRunner::default_max_running()
+                                ,nullptr, true );
     return scheduler;
 }
 
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "alterstack/spin_lock.hpp"
+
+namespace alterstack
+{
+class TaskBase;
+/**
+ * @brief counting Semaphore for Task s, parks current Task instead of blocking OS thread
+ *
+ * Permits counter and waiters stack (intrusive TaskBase list, like Awaitable
+ * wait list) are packed in one 16 byte atomic. acquire(), try_acquire() and
+ * release() without waiters are lock free CAS loops. Waiters exist only while
+ * there are no free permits.
+ *
+ * acquire() takes free permit or parks current Task (AlterNative Task switches
+ * to next running Task, Native Task sleeps on it's thread futex). release() hands
+ * permit over to exactly one waiter and wakes it up through
+ * Scheduler::add_waiting_list_to_running() or, if nobody waits, increments
+ * permits counter. Waiters are woken up in FIFO order: release() takes whole
+ * waiters stack by one CAS, reverses it to FIFO list and hands permits to its
+ * Tasks first. FIFO list is used only by release() with waiters, under
+ * SpinLock held for few pointer operations, and is_fifo_used flag in the same
+ * atomic keeps lock free release() from returning permit while it is not
+ * empty. So early waiters can not starve.
+ *
+ * acquire(), try_acquire() and release() are threadsafe
+ */
+class Semaphore
+{
+public:
+    explicit Semaphore( int32_t count = 0 ) noexcept;
+    ~Semaphore();
+
+    Semaphore( const Semaphore& ) = delete;
+    Semaphore( Semaphore&& )      = delete;
+    Semaphore& operator=( const Semaphore& ) = delete;
+    Semaphore& operator=( Semaphore&& )      = delete;
+
+    void acquire();
+    bool try_acquire() noexcept;
+    void release() noexcept;
+    int32_t count() const noexcept;
+
+    struct SemaphoreData
+    {
+        TaskBase* head;  ///< waiters stack top
+        int32_t   count; ///< free permits
+        uint32_t  is_fifo_used; ///< 1 while m_fifo has waiters
+    };
+private:
+    TaskBase* take_waiters() noexcept;
+    void clear_fifo_used() noexcept;
+
+    ::std::atomic<SemaphoreData> m_data;
+    SpinLock  m_release_lock;    ///< serializes release() with waiters
+    TaskBase* m_fifo = nullptr;  ///< waiters taken from m_data, oldest first
+};
+
+inline Semaphore::Semaphore( int32_t count ) noexcept
+    :m_data{ SemaphoreData{ nullptr, count, 0 } }
+{}
+/**
+ * @brief free permits count (snapshot)
+ * @return free permits count
+ */
+inline int32_t Semaphore::count() const noexcept
+{
+    return m_data.load( std::memory_order_relaxed ).count;
+}
+
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "spin_lock.hpp"
+#include "stack.hpp"
+#include "stack_allocator.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief memory pages used for SlabStackAllocator slabs
+ */
+enum class SlabPages : uint32_t
+{
+    Normal,          ///< common 4K pages
+    TransparentHuge, ///< 2M aligned slab with madvise(MADV_HUGEPAGE)
+    HugeTLB,         ///< mmap(MAP_HUGETLB) from preallocated vm.nr_hugepages pool
+};
+/**
+ * @brief StackAllocator carving many Stack s from one big mapping (slab)
+ *
+ * Each Stack allocated by Stack::Stack() is separate mmap() region (plus PROT_NONE
+ * guard region), so process can not have more than vm.max_map_count / 2 Task s.
+ * SlabStackAllocator reserves slab_size bytes (MAP_NORESERVE) at once and
+ * splits it in Stack s of one size class, so 16K Stack s without guard pages
+ * cost one VMA per 4096 Stack s (with 64M slab).
+ *
+ * Guard pages (StackGuard::Default) are interleaved between Stack s. On Linux 6.13+
+ * they are installed with madvise(MADV_GUARD_INSTALL), which does not split VMA,
+ * on older kernels mprotect() is used and each guard costs VMAs again.
+ *
+ * Slabs are never returned to OS until allocator destroyed. If release_memory
+ * is set, deallocated Stack s are madvise(MADV_DONTNEED)'ed (Normal pages only).
+ *
+ * Huge pages slabs (SlabPages::TransparentHuge or HugeTLB) reduce TLB misses for
+ * Task s switching all the time. They are intended for StackGuard::None Stack s:
+ * guard in TransparentHuge slab splits huge page around it, HugeTLB can not
+ * have 4K guard at all, so guarded Stack s always use Normal pages slab.
+ * If huge pages are not available (no hugetlb pool, THP disabled) slab
+ * silently falls back to Normal pages, huge_page_advised_slab_count() shows how
+ * many slabs were mapped from hugetlb pool or accepted by madvise(MADV_HUGEPAGE).
+ * Kernel still may back advised THP slab by Normal pages (see AnonHugePages in
+ * /proc/self/smaps).
+ *
+ * Slabs can be bound to NUMA node (set_numa_node()), so Stack memory is local
+ * for Task s running on that node (see NumaStackAllocator).
+ *
+ * SlabStackAllocator MUST outlive all Task s using it.
+ *
+ * allocate() and deallocate() are threadsafe
+ */
+class SlabStackAllocator final : public StackAllocator
+{
+public:
+    explicit SlabStackAllocator( size_t slab_size = 64*1024*1024
+                                 ,SlabPages pages = SlabPages::Normal );
+    ~SlabStackAllocator();
+
+    SlabStackAllocator( const SlabStackAllocator& ) = delete;
+    SlabStackAllocator( SlabStackAllocator&& )      = delete;
+    SlabStackAllocator& operator=( const SlabStackAllocator& ) = delete;
+    SlabStackAllocator& operator=( SlabStackAllocator&& )      = delete;
+
+    Stack* allocate( StackSize size_class, StackGuard guard ) override;
+    void   deallocate( Stack* stack ) noexcept override;
+
+    void   set_release_memory( bool release ) noexcept;
+    void   set_numa_node( int32_t node ) noexcept;
+    size_t slab_count() const noexcept;
+    size_t huge_page_advised_slab_count() const noexcept;
+
+private:
+    struct Slab;
+    struct FreeList
+    {
+        SpinLock lock;
+        Stack*   head = nullptr;
+    };
+
+    Stack* create_slab( StackSize size_class, bool is_guarded );
+    void*  map_slab( size_t size, bool is_guarded );
+    void*  map_huge_tlb( size_t size ) noexcept;
+    void*  map_transparent_huge( size_t size ) noexcept;
+    static void install_guard( void* address, size_t size ) noexcept;
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2*1024*1024;
+
+    const size_t        m_slab_size;
+    const SlabPages     m_pages;
+    FreeList            m_free[LIST_COUNT]; ///< one list per size class and guard mode
+    SpinLock            m_slabs_lock;
+    Slab*               m_slabs = nullptr;
+    std::atomic<size_t> m_slab_count     = { 0 };
+    std::atomic<size_t> m_huge_advised_slab_count = { 0 };
+    std::atomic<bool>   m_release_memory = { false };
+    std::atomic<int32_t> m_numa_node     = { -1 };
+};
+/**
+ * @brief madvise(MADV_DONTNEED) deallocated Stack s
+ * @param release true to release physical memory of free Stack s
+ */
+inline void SlabStackAllocator::set_release_memory( bool release ) noexcept
+{
+    m_release_memory.store( release, std::memory_order_relaxed );
+}
+/**
+ * @brief bind new slabs memory to NUMA node
+ *
+ * Already mapped slabs are not moved.
+ * @param node CpuTopology NUMA node or -1 (default memory policy)
+ */
+inline void SlabStackAllocator::set_numa_node( int32_t node ) noexcept
+{
+    m_numa_node.store( node, std::memory_order_relaxed );
+}
+/**
+ * @brief number of mapped slabs
+ * @return slab count
+ */
+inline size_t SlabStackAllocator::slab_count() const noexcept
+{
+    return m_slab_count.load( std::memory_order_relaxed );
+}
+/**
+ * @brief number of slabs mapped with huge pages request
+ *
+ * HugeTLB slabs are backed by huge pages, TransparentHuge slabs are only
+ * advised (madvise() succeeded), kernel decides at page fault.
+ * @return slab count (less than slab_count() if huge pages fallback happened)
+ */
+inline size_t SlabStackAllocator::huge_page_advised_slab_count() const noexcept
+{
+    return m_huge_advised_slab_count.load( std::memory_order_relaxed );
+}
+
+}
@@ -19,28 +19,113 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+
+#include "intrusive_list.hpp"
+#include "passkey.hpp"
 
 namespace alterstack
 {
+template<typename T>
+class LockFreeStack;
+class StackAllocator;
+class SlabStackAllocator;
+/**
+ * @brief Stack size class
+ *
+ * Stack s are allocated (and pooled) only in these fixed sizes.
+ */
+enum class StackSize : uint32_t
+{
+    Size16K  = 0,
+    Size64K  = 1,
+    Size256K = 2,
+    Size1M   = 3,
+    Default  = 4, ///< process wide default, see Stack::set_default_size()
+};
+constexpr uint32_t STACK_SIZE_COUNT = 4; ///< number of real (not Default) size classes
+/**
+ * @brief Stack overflow protection mode
+ */
+enum class StackGuard : uint32_t
+{
+    Default = 0, ///< Stack::default_guard_pages() PROT_NONE pages below stack
+    None    = 1, ///< no guard pages (one VMA per Stack instead of two)
+};
+/**
+ * @brief Stack usage (high water mark) measurement mode
+ */
+enum class StackProbe : uint32_t
+{
+    None      = 0, ///< do not measure
+    Paint     = 1, ///< fill Stack with pattern at Task start, find untouched bytes at finish
+    Residency = 2, ///< mincore() lowest resident page (reused Stack shows its max usage ever)
+};
 /**
  * @brief The Stack class allocates protected stack in constructor and deallocates in destructor
+ *
+ * Stack created by SlabStackAllocator does not own its memory, it is part of
+ * allocator's slab.
+ *
+ * Memory layout (stack grows down):
+ * [ guard pages (PROT_NONE) | usable stack m_size bytes ]
+ * ^ mapping begin           ^ m_base                    ^ stack_top()
  */
-class Stack
+class Stack : private IntrusiveList<Stack>
 {
 public:
-    Stack();
+    explicit Stack( StackSize size_class = StackSize::Default
+                    ,StackGuard guard = StackGuard::Default );
+    Stack( Passkey<SlabStackAllocator>
+           ,void* base
+           ,size_t guard_size
+           ,StackSize size_class
+           ,StackGuard guard ) noexcept;
     ~Stack();
 
+    Stack( const Stack& ) = delete;
+    Stack( Stack&& )      = delete;
+    Stack& operator=( const Stack& ) = delete;
+    Stack& operator=( Stack&& )      = delete;
+
     void* stack_top() const noexcept;
     size_t size() const noexcept;
+    StackSize size_class() const noexcept;
+    StackGuard guard() const noexcept;
+    bool      is_guarded() const noexcept;
+    StackAllocator* allocator() const noexcept;
+    void release_memory() noexcept;
+    void paint( size_t keep_top = 0 ) noexcept;
+    size_t used_bytes( StackProbe probe ) const noexcept;
+
+    static size_t    bytes( StackSize size_class ) noexcept;
+    static StackSize resolve( StackSize size_class ) noexcept;
+    static StackSize default_size() noexcept;
+    static void      set_default_size( StackSize size_class ) noexcept;
+    static uint32_t  default_guard_pages() noexcept;
+    static void      set_default_guard_pages( uint32_t count ) noexcept;
+    static size_t    page_size() noexcept;
+    static StackProbe usage_probe() noexcept;
+    static void      set_usage_probe( StackProbe probe ) noexcept;
 
 private:
-    void*  m_base;
-    size_t m_size;
+    void*     m_base;       ///< usable stack memory begin (guard pages are below it)
+    size_t    m_size;       ///< usable stack size
+    size_t    m_guard_size; ///< guard pages size in bytes (0 - not guarded)
+    StackSize m_size_class;
+    StackGuard m_guard;     ///< requested guard mode, free lists are keyed by it
+    bool      m_owns_memory;           ///< true if munmap() required in destructor
+    StackAllocator* m_allocator = nullptr; ///< allocator to return Stack to
 #if defined(WITH_VALGRIND)
     unsigned m_valgrind_stack_id;
 #endif
+
+    friend class StackPool;
+    friend class StackAllocator;
+    friend class SlabStackAllocator;
+    friend class LockFreeStack<Stack>;
 };
 /**
  * @brief address for empty stack pointer
@@ -58,5 +143,63 @@ inline size_t Stack::size() const noexcept
 {
     return m_size;
 }
+/**
+ * @brief stack size class
+ * @return size class (never StackSize::Default)
+ */
+inline StackSize Stack::size_class() const noexcept
+{
+    return m_size_class;
+}
+/**
+ * @brief guard mode Stack was requested with
+ *
+ * StackGuard::Default Stack has no guard pages if Stack::default_guard_pages()
+ * was 0 at allocation time, so allocators use this (not is_guarded()) to
+ * select free list and hit the same list in get() and put().
+ * @return requested StackGuard
+ */
+inline StackGuard Stack::guard() const noexcept
+{
+    return m_guard;
+}
+/**
+ * @brief check if Stack has guard pages
+ * @return true if overflow protected
+ */
+inline bool Stack::is_guarded() const noexcept
+{
+    return m_guard_size != 0;
+}
+/**
+ * @brief allocator owning this Stack
+ * @return StackAllocator* (nullptr for Stack created directly)
+ */
+inline StackAllocator* Stack::allocator() const noexcept
+{
+    return m_allocator;
+}
+/**
+ * @brief memory size for stack size class
+ * @param size_class stack size class
+ * @return size in bytes
+ */
+inline size_t Stack::bytes( StackSize size_class ) noexcept
+{
+    return size_t(16*1024) << ( 2 * static_cast<uint32_t>( resolve( size_class ) ) );
+}
+/**
+ * @brief replace StackSize::Default with current process wide default
+ * @param size_class stack size class
+ * @return real size class
+ */
+inline StackSize Stack::resolve( StackSize size_class ) noexcept
+{
+    if( size_class == StackSize::Default )
+    {
+        return default_size();
+    }
+    return size_class;
+}
 
 }
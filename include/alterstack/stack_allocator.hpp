@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "stack.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief interface for Stack allocation strategies
+ *
+ * Task gets its Stack from StackAllocator (TaskOptions::stack_allocator or
+ * process wide default) and gives it back to the same allocator (Stack::allocator())
+ * when finished.
+ *
+ * Implementations:
+ * - StackPool - mmap() per Stack with thread local and global caching (default)
+ * - SlabStackAllocator - many Stack s carved from one big mapping
+ * - NumaStackAllocator - SlabStackAllocator per NUMA node
+ *
+ * allocate() and deallocate() MUST be threadsafe
+ */
+class StackAllocator
+{
+public:
+    struct Deleter
+    {
+        void operator()( Stack* stack ) const noexcept;
+    };
+
+    virtual ~StackAllocator() = default;
+    /**
+     * @brief allocate Stack
+     * @param size_class stack size class (StackSize::Default allowed)
+     * @param guard stack guard mode
+     * @return Stack* with allocator() == this, throws std::bad_alloc on failure
+     */
+    virtual Stack* allocate( StackSize size_class, StackGuard guard ) = 0;
+    /**
+     * @brief give Stack back, it must not be used by any Task
+     * @param stack Stack* allocated by this allocator
+     */
+    virtual void   deallocate( Stack* stack ) noexcept = 0;
+
+    static StackAllocator* default_allocator() noexcept;
+    static void set_default_allocator( StackAllocator* allocator ) noexcept;
+
+protected:
+    static constexpr uint32_t LIST_COUNT = STACK_SIZE_COUNT * 2; ///< guarded and not guarded
+    static uint32_t list_index( StackSize size_class, bool is_guarded ) noexcept;
+    static void set_allocator( Stack* stack, StackAllocator* allocator ) noexcept;
+};
+
+using StackPtr = std::unique_ptr<Stack, StackAllocator::Deleter>;
+
+/**
+ * @brief return Stack back to its StackAllocator
+ * @param stack Stack* to release
+ */
+inline void StackAllocator::Deleter::operator()( Stack* stack ) const noexcept
+{
+    stack->allocator()->deallocate( stack );
+}
+/**
+ * @brief get free list index for Stack type
+ *
+ * Allocators keep separate free lists for each size class and guard mode.
+ * @param size_class resolved (not Default) stack size class
+ * @param is_guarded true for Stack with guard pages
+ * @return list index in [0, LIST_COUNT)
+ */
+inline uint32_t StackAllocator::list_index( StackSize size_class, bool is_guarded ) noexcept
+{
+    return static_cast<uint32_t>( size_class ) * 2 + ( is_guarded ? 0 : 1 );
+}
+/**
+ * @brief mark Stack as owned by allocator
+ * @param stack Stack* to mark
+ * @param allocator owning StackAllocator
+ */
+inline void StackAllocator::set_allocator( Stack* stack, StackAllocator* allocator ) noexcept
+{
+    stack->m_allocator = allocator;
+}
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "lock_free_stack.hpp"
+#include "stack.hpp"
+#include "stack_allocator.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief Cache of ready to use Stack s to make Task creation syscall free
+ *
+ * Creating new Stack costs mmap() + mprotect() and destroying it costs munmap()
+ * (with TLB shootdown on all CPUs running this process). StackPool keeps released
+ * Stack s and gives them back to new Task s.
+ *
+ * Stack s are cached separately for each StackSize class and StackGuard mode,
+ * limits are per list.
+ *
+ * Released Stack goes to thread local cache first (no atomics at all), when thread
+ * cache is full Stack goes to global lockfree overflow list. Global list size is
+ * bounded by max_global high water mark, Stack s over it will be deallocated.
+ * get() takes Stack from thread cache, then whole global list (to own thread cache)
+ * and only if both are empty allocates new Stack.
+ *
+ * If release_memory is set, Stack moved to global list will be madvise(MADV_DONTNEED)'ed,
+ * so cold cached Stack s do not hold physical memory.
+ *
+ * StackPool is process wide default StackAllocator. It is never destroyed,
+ * so BgThread s and detached Task s finishing during static destruction can
+ * still return Stack s to it.
+ *
+ * get() and put() are threadsafe
+ */
+class StackPool final : public StackAllocator
+{
+public:
+    static StackPool& instance();
+
+    StackPool( const StackPool& ) = delete;
+    StackPool( StackPool&& )      = delete;
+    StackPool& operator=( const StackPool& ) = delete;
+    StackPool& operator=( StackPool&& )      = delete;
+
+    Stack* get( StackSize size_class = StackSize::Default
+                ,StackGuard guard = StackGuard::Default );
+    void   put( Stack* stack ) noexcept;
+
+    Stack* allocate( StackSize size_class, StackGuard guard ) override;
+    void   deallocate( Stack* stack ) noexcept override;
+
+    void set_thread_cache_size( uint32_t size ) noexcept;
+    void set_max_global( uint32_t size ) noexcept;
+    void set_release_memory( bool release ) noexcept;
+
+private:
+    StackPool() noexcept;
+
+    struct ThreadCache;
+    static ThreadCache& thread_cache( uint32_t index );
+
+    void   get_from_global( ThreadCache& cache, uint32_t index ) noexcept;
+    void   put_to_global( Stack* stack ) noexcept;
+    void   flush_thread_cache( ThreadCache& cache ) noexcept;
+
+    LockFreeStack<Stack>  m_global[LIST_COUNT]; ///< one list per size class and guard mode
+    std::atomic<uint32_t> m_global_count[LIST_COUNT];
+    std::atomic<uint32_t> m_thread_cache_size = { 16 };
+    std::atomic<uint32_t> m_max_global        = { 256 };
+    std::atomic<bool>     m_release_memory    = { false };
+};
+
+/**
+ * @brief get StackPool instance singleton
+ * @return StackPool& singleton instance
+ */
+inline StackPool& StackPool::instance()
+{
+    // intentionally leaked: it MUST outlive every Scheduler and thread cache
+    static typename std::aligned_storage<sizeof(StackPool), alignof(StackPool)>::type storage;
+    static StackPool* pool = new( &storage ) StackPool();
+    return *pool;
+}
+/**
+ * @brief StackAllocator interface, same as get()
+ */
+inline Stack* StackPool::allocate( StackSize size_class, StackGuard guard )
+{
+    return get( size_class, guard );
+}
+/**
+ * @brief StackAllocator interface, same as put()
+ */
+inline void StackPool::deallocate( Stack* stack ) noexcept
+{
+    put( stack );
+}
+/**
+ * @brief set max Stack count in each thread cache (0 - disable thread cache)
+ * @param size max cached Stack count per thread
+ */
+inline void StackPool::set_thread_cache_size( uint32_t size ) noexcept
+{
+    m_thread_cache_size.store( size, std::memory_order_relaxed );
+}
+/**
+ * @brief set high water mark for global overflow list (0 - disable global list)
+ * @param size max Stack count in global list
+ */
+inline void StackPool::set_max_global( uint32_t size ) noexcept
+{
+    m_max_global.store( size, std::memory_order_relaxed );
+}
+/**
+ * @brief madvise(MADV_DONTNEED) Stack s moved to global list
+ * @param release true to release physical memory of cold Stack s
+ */
+inline void StackPool::set_release_memory( bool release ) noexcept
+{
+    m_release_memory.store( release, std::memory_order_relaxed );
+}
+
+}
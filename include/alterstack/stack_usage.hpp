@@ -0,0 +1,97 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "stack.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief process wide histogram of Stack usage reported by finished Task s
+ *
+ * Task reports its Stack high water mark (see Stack::set_usage_probe()) at finish.
+ * Usage is counted in power of two buckets per StackSize class:
+ * bucket 0 - up to 1K, bucket 1 - up to 2K, ... bucket 10 - up to 1M.
+ *
+ * Histogram shows if Stack size class can be safely reduced, for example if all
+ * Size1M Task s are in buckets up to 16K they fit in StackSize::Size64K with reserve.
+ *
+ * add() and histogram() are threadsafe (histogram() is not atomic snapshot)
+ */
+class StackUsageStats
+{
+public:
+    static constexpr uint32_t BUCKET_COUNT = 11;
+
+    struct Histogram
+    {
+        uint64_t count[BUCKET_COUNT]; ///< Task s count in each bucket
+        uint64_t samples;             ///< total Task s count
+        size_t   max_used;            ///< max used bytes
+    };
+
+    static StackUsageStats& instance();
+
+    StackUsageStats( const StackUsageStats& ) = delete;
+    StackUsageStats( StackUsageStats&& )      = delete;
+    StackUsageStats& operator=( const StackUsageStats& ) = delete;
+    StackUsageStats& operator=( StackUsageStats&& )      = delete;
+
+    void      add( StackSize size_class, size_t used ) noexcept;
+    Histogram histogram( StackSize size_class ) const noexcept;
+    void      reset() noexcept;
+
+    static size_t   bucket_limit( uint32_t bucket ) noexcept;
+    static uint32_t bucket( size_t used ) noexcept;
+
+private:
+    StackUsageStats() noexcept;
+
+    struct ClassStats
+    {
+        std::atomic<uint64_t> count[BUCKET_COUNT];
+        std::atomic<size_t>   max_used;
+    };
+    ClassStats m_stats[STACK_SIZE_COUNT];
+};
+/**
+ * @brief get StackUsageStats instance singleton
+ * @return StackUsageStats& singleton instance
+ */
+inline StackUsageStats& StackUsageStats::instance()
+{
+    static StackUsageStats stats;
+    return stats;
+}
+/**
+ * @brief max used bytes counted in bucket
+ * @param bucket bucket index
+ * @return bucket upper bound in bytes
+ */
+inline size_t StackUsageStats::bucket_limit( uint32_t bucket ) noexcept
+{
+    return size_t(1024) << bucket;
+}
+
+}
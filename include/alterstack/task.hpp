@@ -23,10 +23,14 @@
 #include <cstdint>
 #include <memory>
 #include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #include "intrusive_list.hpp"
 #include "awaitable.hpp"
 #include "stack.hpp"
+#include "stack_allocator.hpp"
 #include "context.hpp"
 #include "passkey.hpp"
 
@@ -43,12 +47,22 @@ enum class TaskState
 class TaskRunner;
 class Scheduler;
 class Awaitable;
+class Mutex;
+class ConditionVariable;
+class Semaphore;
+class Event;
+template<typename T>
+class Channel;
 template<typename Task>
 class BoundBuffer;
 template<typename Task>
 class LockFreeStack;
 template<typename Task>
 class LockFreeQueue;
+template<typename Task, uint32_t LEVEL_COUNT>
+class MultiLevelQueue;
+template<typename Task, size_t CAPACITY>
+class MpmcRingQueue;
 /**
  * @brief Main class to start and wait tasks.
  *
@@ -79,22 +93,53 @@ protected:
 
     Awaitable              m_awaitable;
     // m_context == nullptr when some thread running this context
+    // (or Scheduler::WAKEUP_PENDING if Task was released while switching out)
     std::atomic<Context>   m_context = { nullptr };
     std::atomic<TaskState> m_state   = { TaskState::Running };
+    bool m_is_parking = false; ///< Task switches out to wait, owner thread only
+    void* m_wait_data = nullptr; ///< parked Task data of waited primitive (Channel)
     const bool m_is_thread_bound;
 
 private:
     friend class Scheduler;
     friend class Awaitable;
+    friend class Mutex;
+    friend class ConditionVariable;
+    friend class Semaphore;
+    friend class Event;
+    template<typename T>
+    friend class Channel;
     friend class BoundBuffer<TaskBase>;
     friend class LockFreeStack<TaskBase>;
     friend LockFreeQueue<TaskBase>;
+    friend class MultiLevelQueue<TaskBase, 4>;
+    friend class MpmcRingQueue<TaskBase, 512>;
     friend class UnitTestAccessor;
     friend class BgRunner;
     friend class Task;
     friend class BoundTask;
 };
 
+/**
+ * @brief new Task launch policy
+ */
+enum class TaskLaunch
+{
+    Immediate, ///< switch to new Task right in constructor, creator stay Running
+    Enqueue,   ///< put new Task in running queue, creator continue running
+};
+/**
+ * @brief Task creation options
+ */
+struct TaskOptions
+{
+    StackSize  stack_size  = StackSize::Default;  ///< Stack size class for new Task
+    StackGuard stack_guard = StackGuard::Default; ///< Stack overflow protection
+    StackAllocator* stack_allocator = nullptr;    ///< nullptr - Scheduler::stack_allocator()
+    TaskLaunch launch = TaskLaunch::Immediate;    ///< switch to new Task or enqueue it
+    Scheduler* scheduler = nullptr;               ///< nullptr - Scheduler::current()
+};
+
 class Task final : public TaskBase
 {
 public:
@@ -106,22 +151,222 @@ public:
         Batch = 3,
         MaxNum = Batch
     };
+    /**
+     * @brief destroy Task created by Task::spawn() and free its Stack
+     */
+    struct Deleter
+    {
+        void operator()( Task* task ) const noexcept;
+    };
 
-    Task( ::std::function<void()> runnable ); ///< will create unbound Task
+    template<typename Callable
+             ,typename = typename std::enable_if<
+                 !std::is_base_of<TaskBase, typename std::decay<Callable>::type>::value>::type>
+    Task( Callable&& runnable, const TaskOptions& options = TaskOptions{} ); ///< will create unbound Task
+    Task( Passkey<Task>, Scheduler* scheduler, Stack* stack, size_t reserved, StackProbe probe
+          ,void* runnable, void (*invoke)( void* runnable ), bool is_detached
+          ,TaskLaunch launch );
     ~Task();
 
+    template<typename Callable>
+    static std::unique_ptr<Task, Deleter> spawn( Callable&& runnable
+                                                 ,const TaskOptions& options = TaskOptions{} );
+    template<typename Callable>
+    static void spawn_detached( Callable&& runnable, const TaskOptions& options = TaskOptions{} );
+    template<typename State, typename Callable>
+    static std::unique_ptr<Task, Deleter> spawn_with_state( Callable&& runnable, State*& state
+                                                            ,const TaskOptions& options = TaskOptions{} );
+
     static void yield();
+    static void migrate( Scheduler& scheduler );
     Priority priority();
     void     set_priority( Priority prio );
 
 private:
     [[noreturn]]
     static void _run_wrapper( ::scontext::transfer_t transfer ) noexcept;
+    template<typename Runnable>
+    static void invoke_runnable( void* runnable );
+    template<typename Callable>
+    static Task* create_embedded( Callable&& runnable, const TaskOptions& options
+                                  ,bool is_detached );
+    static void destroy_embedded( Task* task ) noexcept;
+    static Scheduler* target_scheduler( const TaskOptions& options );
+    static Stack* allocate_stack( Scheduler* scheduler, const TaskOptions& options );
+    static void* reserve_stack_top( const Stack& stack, size_t& reserved
+                                    ,size_t size, size_t alignment );
+    void start( TaskLaunch launch );
+    void wait_finished();
+    void report_stack_usage() noexcept;
+
+    using InvokeFunction = void (*)( void* runnable );
 
-    Priority                m_priority = { Priority::Normal }; ///< scheduling priority
-    std::unique_ptr<Stack>  m_stack;
-    ::std::function<void()> m_runnable;
+    Priority       m_priority = { Priority::Normal }; ///< scheduling priority
+    Scheduler*     m_scheduler;             ///< Scheduler running this Task
+    StackPtr       m_stack;
+    StackProbe     m_usage_probe;           ///< Stack usage measurement mode
+    size_t         m_stack_reserved = 0;    ///< bytes at Stack top used by runnable (and Task)
+    void*          m_runnable = nullptr;    ///< runnable object placed at Stack top
+    InvokeFunction m_invoke   = nullptr;    ///< calls and destroys m_runnable
+    const bool     m_is_detached = false;   ///< owned by Scheduler, destroyed when finished
+
+    friend class Scheduler;
 };
+/**
+ * @brief owner of Task embedded in its own Stack (created by Task::spawn())
+ */
+using TaskHandle = std::unique_ptr<Task, Task::Deleter>;
+/**
+ * @brief constructor to create thread unbound Task
+ *
+ * runnable is moved (or copied) to the top of Task's own Stack, so Task creation does
+ * not allocate any memory except Stack (which is usually cached by StackAllocator).
+ * runnable is destroyed by Task itself right after it returns.
+ * @param runnable void() function or functor to start (lambda, std::function, std::bind...)
+ * @param options Task options (Stack size class, guard mode, allocator, launch policy
+ * and Scheduler)
+ */
+template<typename Callable, typename>
+Task::Task( Callable&& runnable, const TaskOptions& options )
+    :TaskBase{ false }
+    ,m_scheduler{ target_scheduler( options ) }
+    ,m_stack{ allocate_stack( m_scheduler, options ) }
+    ,m_usage_probe{ Stack::usage_probe() }
+{
+    using Runnable = typename std::decay<Callable>::type;
+    if( m_usage_probe == StackProbe::Paint )
+    {
+        m_stack->paint();
+    }
+    void* place = reserve_stack_top( *m_stack, m_stack_reserved
+                                     ,sizeof(Runnable), alignof(Runnable) );
+    m_runnable = new( place ) Runnable( std::forward<Callable>( runnable ) );
+    m_invoke   = &invoke_runnable<Runnable>;
+    start( options.launch );
+}
+/**
+ * @brief create and start thread unbound Task placed at the top of its own Stack
+ *
+ * Task control block, runnable and coroutine stack share one Stack mapping,
+ * so Task creation needs only one Stack from StackAllocator and scheduler
+ * touches Task and its hot stack frames in the same memory region.
+ * @param runnable void() function or functor to start
+ * @param options Task options (Stack size class, guard mode and allocator)
+ * @return TaskHandle, its destructor will wait Task finished and free Stack
+ */
+template<typename Callable>
+TaskHandle Task::spawn( Callable&& runnable, const TaskOptions& options )
+{
+    return TaskHandle{ create_embedded( std::forward<Callable>( runnable ), options, false ) };
+}
+/**
+ * @brief create and start Task owned by Scheduler (fire-and-forget)
+ *
+ * Task is placed at the top of its own Stack like Task::spawn(). Scheduler
+ * destroys Task and frees its Stack right after Task finished, so caller
+ * does not need to keep any Task object.
+ * @param runnable void() function or functor to start
+ * @param options Task options (Stack size class, guard mode and allocator)
+ */
+template<typename Callable>
+void Task::spawn_detached( Callable&& runnable, const TaskOptions& options )
+{
+    create_embedded( std::forward<Callable>( runnable ), options, true );
+}
+/**
+ * @brief create and start Task with State object placed next to it at Stack top
+ *
+ * Like Task::spawn(), but State is default constructed in the same Stack
+ * before Task starts and runnable is called as runnable( State& ). State
+ * outlives runnable, so Task can leave its result there without any
+ * allocation. Caller owns State: it MUST destroy *state after Task finished
+ * (join()) and before TaskHandle destroyed.
+ * @param runnable void( State& ) function or functor to start
+ * @param state pointer to created State
+ * @param options Task options (Stack size class, guard mode and allocator)
+ * @return TaskHandle, its destructor will wait Task finished and free Stack
+ */
+template<typename State, typename Callable>
+TaskHandle Task::spawn_with_state( Callable&& runnable, State*& state, const TaskOptions& options )
+{
+    using Function = typename std::decay<Callable>::type;
+    struct Runnable
+    {
+        void operator()()
+        {
+            function( *state );
+        }
+        Function function;
+        State*   state;
+    };
+    Scheduler* scheduler = target_scheduler( options );
+    StackPtr stack{ allocate_stack( scheduler, options ) };
+    size_t reserved = 0;
+    void* task_place = reserve_stack_top( *stack, reserved, sizeof(Task), alignof(Task) );
+    void* state_place = reserve_stack_top( *stack, reserved, sizeof(State), alignof(State) );
+    void* runnable_place = reserve_stack_top( *stack, reserved
+                                              ,sizeof(Runnable), alignof(Runnable) );
+    StackProbe probe = Stack::usage_probe();
+    if( probe == StackProbe::Paint )
+    {
+        stack->paint( reserved );
+    }
+    State* new_state = new( state_place ) State();
+    void* function = nullptr;
+    try
+    {
+        function = new( runnable_place ) Runnable{ Function( std::forward<Callable>( runnable ) )
+                                                   ,new_state };
+    }
+    catch( ... )
+    {
+        // Stack is returned by StackPtr, State lives in it and must be destroyed first
+        new_state->~State();
+        throw;
+    }
+    state = new_state;
+    return TaskHandle{ new( task_place ) Task( Passkey<Task>{}, scheduler, stack.release(), reserved
+                                               ,probe, function, &invoke_runnable<Runnable>, false
+                                               ,options.launch ) };
+}
+/**
+ * @brief place Task and runnable at Stack top and start Task
+ * @param runnable void() function or functor to start
+ * @param options Task options (Stack size class, guard mode and allocator)
+ * @param is_detached Task will be destroyed by Scheduler when finished
+ * @return Task* (already destroyed one if is_detached, MUST not be used)
+ */
+template<typename Callable>
+Task* Task::create_embedded( Callable&& runnable, const TaskOptions& options, bool is_detached )
+{
+    using Runnable = typename std::decay<Callable>::type;
+    Scheduler* scheduler = target_scheduler( options );
+    StackPtr stack{ allocate_stack( scheduler, options ) };
+    size_t reserved = 0;
+    void* task_place = reserve_stack_top( *stack, reserved, sizeof(Task), alignof(Task) );
+    void* runnable_place = reserve_stack_top( *stack, reserved
+                                              ,sizeof(Runnable), alignof(Runnable) );
+    StackProbe probe = Stack::usage_probe();
+    if( probe == StackProbe::Paint )
+    {
+        stack->paint( reserved );
+    }
+    void* function = new( runnable_place ) Runnable( std::forward<Callable>( runnable ) );
+    return new( task_place ) Task( Passkey<Task>{}, scheduler, stack.release(), reserved, probe
+                                   ,function, &invoke_runnable<Runnable>, is_detached
+                                   ,options.launch );
+}
+/**
+ * @brief call runnable placed at Stack top and destroy it
+ * @param runnable pointer to Runnable object
+ */
+template<typename Runnable>
+void Task::invoke_runnable( void* runnable )
+{
+    Runnable& function = *static_cast<Runnable*>( runnable );
+    function();
+    function.~Runnable();
+}
 
 inline Task::Priority Task::priority()
 {
@@ -48,8 +48,9 @@ public:
     static void  set_current_task( TaskBase* new_task );
     static TaskBase* native_task();
     RunnerType   type();
+    BgThread*    bg_thread() noexcept;
 
-    void make_bg_runner( Passkey<BgThread> );
+    void make_bg_runner( Passkey<BgThread>, BgThread* bg_thread );
 
     Futex native_futex;
 private:
@@ -59,6 +60,7 @@ private:
     BoundTask  m_native_task;
     TaskBase*  m_current_task = nullptr;
     RunnerType m_runner_type;
+    BgThread*  m_bg_thread = nullptr; ///< BgThread owning this OS thread or nullptr
 };
 
 inline TaskRunner::TaskRunner()
@@ -91,9 +93,19 @@ inline RunnerType TaskRunner::type()
     return m_runner_type;
 }
 
-inline void TaskRunner::make_bg_runner( Passkey<BgThread> )
+/**
+ * @brief get BgThread running on current OS thread
+ * @return BgThread* or nullptr for CommonThread
+ */
+inline BgThread* TaskRunner::bg_thread() noexcept
+{
+    return m_bg_thread;
+}
+
+inline void TaskRunner::make_bg_runner( Passkey<BgThread>, BgThread* bg_thread )
 {
     set_type( RunnerType::BgRunner );
+    m_bg_thread = bg_thread;
 }
 
 inline void TaskRunner::set_type(RunnerType type)
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace alterstack
+{
+/**
+ * @brief bounded per worker run queue with LIFO slot and work stealing
+ *
+ * Single owner thread puts items, any thread can take them.
+ *
+ * push(T*) (owner only) will store T* in FIFO ring, returns false if ring is full
+ *
+ * push_next(T*) (owner only) will store T* in LIFO slot, item from LIFO slot
+ * (if any) moves to ring, returns that item if it did not fit there (caller MUST store it)
+ *
+ * pop() (owner only) returns item from LIFO slot or oldest item from ring
+ *
+ * steal() (any thread) returns oldest item from ring or item from LIFO slot
+ * if ring is empty
+ *
+ * Ring indexes are never reset, they wrap around uint32_t, so (tail - head)
+ * is always items count in ring. Only owner changes m_tail, item leaves
+ * ring when some thread (owner or thief) successfully moves m_head with CAS.
+ * @tparam T item type (items are not modified)
+ * @tparam CAPACITY ring capacity, MUST be power of 2
+ */
+template<typename T, uint32_t CAPACITY = 256>
+class WorkStealingQueue
+{
+    static_assert( ( CAPACITY & ( CAPACITY - 1 ) ) == 0, "CAPACITY MUST be power of 2" );
+public:
+    WorkStealingQueue() noexcept;
+
+    WorkStealingQueue( const WorkStealingQueue& ) = delete;
+    WorkStealingQueue( WorkStealingQueue&& )      = delete;
+    WorkStealingQueue& operator=( const WorkStealingQueue& ) = delete;
+    WorkStealingQueue& operator=( WorkStealingQueue&& )      = delete;
+
+    bool push( T* item ) noexcept;
+    T*   push_next( T* item ) noexcept;
+    T*   pop() noexcept;
+    T*   steal() noexcept;
+    bool empty() const noexcept;
+
+private:
+    T* pop_ring() noexcept;
+
+    std::atomic<T*>       m_next;            // LIFO slot
+    std::atomic<uint32_t> m_head;            // next item to take, changed by owner and thieves
+    // padding to keep owner's m_tail away from m_head (no alignas, because
+    // BgThread with WorkStealingQueue is created by new)
+    char m_padding[ 64 - sizeof(std::atomic<T*>) - sizeof(std::atomic<uint32_t>) ];
+    std::atomic<uint32_t> m_tail;            // next free place, changed by owner only
+    std::atomic<T*>       m_items[ CAPACITY ];
+};
+
+template<typename T, uint32_t CAPACITY>
+WorkStealingQueue<T,CAPACITY>::WorkStealingQueue() noexcept
+{
+    m_next.store( nullptr, std::memory_order_relaxed );
+    m_head.store( 0, std::memory_order_relaxed );
+    m_tail.store( 0, std::memory_order_relaxed );
+    for( auto& item: m_items )
+    {
+        item.store( nullptr, std::memory_order_relaxed );
+    }
+}
+/**
+ * @brief store T* in ring (FIFO order), owner thread only
+ * @param item T* to store
+ * @return false if ring is full (item was not stored)
+ */
+template<typename T, uint32_t CAPACITY>
+bool WorkStealingQueue<T,CAPACITY>::push( T* item ) noexcept
+{
+    uint32_t tail = m_tail.load( std::memory_order_relaxed );
+    uint32_t head = m_head.load( std::memory_order_acquire );
+    if( tail - head >= CAPACITY )
+    {
+        return false;
+    }
+    m_items[ tail & ( CAPACITY - 1 ) ].store( item, std::memory_order_relaxed );
+    m_tail.store( tail + 1, std::memory_order_release );
+    return true;
+}
+/**
+ * @brief store T* in LIFO slot (it will be taken first), owner thread only
+ *
+ * Previous LIFO slot item moves to ring.
+ * @param item T* to store
+ * @return nullptr or previous LIFO slot item which did not fit in ring
+ */
+template<typename T, uint32_t CAPACITY>
+T* WorkStealingQueue<T,CAPACITY>::push_next( T* item ) noexcept
+{
+    T* prev = m_next.exchange( item, std::memory_order_acq_rel );
+    if( prev == nullptr
+            || push( prev ) )
+    {
+        return nullptr;
+    }
+    return prev;
+}
+/**
+ * @brief get T* from LIFO slot or from ring, owner thread only
+ * @return T* or nullptr if queue is empty
+ */
+template<typename T, uint32_t CAPACITY>
+T* WorkStealingQueue<T,CAPACITY>::pop() noexcept
+{
+    T* next = m_next.load( std::memory_order_relaxed );
+    if( next != nullptr
+            && m_next.compare_exchange_strong( next, nullptr
+                                               ,std::memory_order_acquire
+                                               ,std::memory_order_relaxed ) )
+    {
+        return next;
+    }
+    return pop_ring();
+}
+/**
+ * @brief get T* from other thread's queue
+ *
+ * LIFO slot item will be stolen only if ring is empty, because owner
+ * will most likely run it soon (it has hot cache).
+ * @return T* or nullptr if queue is empty
+ */
+template<typename T, uint32_t CAPACITY>
+T* WorkStealingQueue<T,CAPACITY>::steal() noexcept
+{
+    T* item = pop_ring();
+    if( item != nullptr )
+    {
+        return item;
+    }
+    item = m_next.load( std::memory_order_relaxed );
+    if( item != nullptr
+            && m_next.compare_exchange_strong( item, nullptr
+                                               ,std::memory_order_acquire
+                                               ,std::memory_order_relaxed ) )
+    {
+        return item;
+    }
+    return nullptr;
+}
+/**
+ * @brief check queue is empty (approximate if called not by owner)
+ * @return true if queue is empty
+ */
+template<typename T, uint32_t CAPACITY>
+bool WorkStealingQueue<T,CAPACITY>::empty() const noexcept
+{
+    return m_next.load( std::memory_order_acquire ) == nullptr
+            && m_head.load( std::memory_order_acquire ) == m_tail.load( std::memory_order_acquire );
+}
+/**
+ * @brief get oldest T* from ring, any thread
+ * @return T* or nullptr if ring is empty
+ */
+template<typename T, uint32_t CAPACITY>
+T* WorkStealingQueue<T,CAPACITY>::pop_ring() noexcept
+{
+    uint32_t head = m_head.load( std::memory_order_acquire );
+    while( true )
+    {
+        uint32_t tail = m_tail.load( std::memory_order_acquire );
+        if( head == tail )
+        {
+            return nullptr;
+        }
+        if( tail - head > CAPACITY ) // inconsistent head and tail, reread
+        {
+            head = m_head.load( std::memory_order_acquire );
+            continue;
+        }
+        T* item = m_items[ head & ( CAPACITY - 1 ) ].load( std::memory_order_relaxed );
+        if( m_head.compare_exchange_weak( head, head + 1
+                                          ,std::memory_order_acq_rel
+                                          ,std::memory_order_acquire ) )
+        {
+            return item;
+        }
+    }
+}
+
+}
@@ -38,27 +38,20 @@ Awaitable::~Awaitable()
     wait();
 }
 
-bool Awaitable::insert_current_task_in_waitlist()
+bool Awaitable::insert_current_task_in_waitlist( ::std::atomic<AwaitableData>& data )
 {
     TaskBase* const current_task = Scheduler::get_current_task();
-    AwaitableData aw_data = ::std::atomic_load_explicit(&m_data,::std::memory_order_acquire);
+    AwaitableData aw_data = ::std::atomic_load_explicit(&data,::std::memory_order_acquire);
     if( aw_data.is_finished )
     {
         return false;
     }
-    // locking not needed because external task can change state
-    // only from Waiting to Running at wakeup but current_task still not in wait queue
-    current_task->m_state = TaskState::Waiting;
-    // Task* current_task will be placed in wait list and small time later
-    // it will switch to other task but if this task is AlterNative
-    // in this tiny time it can be woken up, moved in running queue and executed
-    // m_context = nullptr to protect from switching to it
-    current_task->m_context = nullptr;
+    Scheduler::prepare_park( current_task );
     current_task->set_next( aw_data.head );
     AwaitableData new_aw_data;
     new_aw_data.head = current_task;
     while(!::std::atomic_compare_exchange_weak_explicit(
-              &m_data
+              &data
               ,&aw_data
               ,new_aw_data
               ,::std::memory_order_release
@@ -66,10 +59,7 @@ bool Awaitable::insert_current_task_in_waitlist()
     {
         if( aw_data.is_finished )
         {
-            // locking not needed because external task can change state
-            // only from Waiting to Running at wakeup but current_task still not in wait queue
-            current_task->m_state = TaskState::Running;
-            current_task->m_context = (void*)0x01;
+            Scheduler::cancel_park( current_task );
             return false;
         }
         current_task->set_next( aw_data.head );
@@ -79,7 +69,7 @@ bool Awaitable::insert_current_task_in_waitlist()
 
 void Awaitable::wait()
 {
-    if( insert_current_task_in_waitlist() )
+    if( insert_current_task_in_waitlist( m_data ) )
     {
         Scheduler::schedule();
     }
@@ -19,42 +19,171 @@
 
 #include "alterstack/bg_runner.hpp"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <system_error>
+
 #include "alterstack/atomic_guard.hpp"
+#include "alterstack/cpu_topology.hpp"
 #include "alterstack/scheduler.hpp"
 #include "alterstack/task.hpp"
 
 namespace alterstack
 {
+namespace
+{
+std::atomic<uint32_t> min_spare_threads{ 1 };
+std::atomic<uint32_t> max_running_threads{ 0 }; // 0 - std::thread::hardware_concurrency()
+std::atomic<int64_t>  idle_timeout_ms{ 1000 };
+std::atomic<uint32_t> spin_iterations{ 256 };
+std::atomic<uint32_t> spinning_threads{ 0 };   // 0 - half of running BgThread's
+
+std::mutex            affinity_mutex;
+ThreadAffinity        thread_affinity = ThreadAffinity::None;
+std::vector<uint32_t> affinity_cpus;           // empty - all CPUs
+
+int64_t now_ns() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+}
 /**
  * @brief thread pool constructor
  * @param scheduler Scheduler reference
- * @param min_spare number of threads to start
+ * @param min_spare number of threads to start (at least 1)
  * @param max_running max BgThread to use
  */
 BgRunner::BgRunner(
         Scheduler* scheduler
         ,uint32_t min_spare
         ,uint32_t max_running )
+    :m_min_spare( std::max( min_spare, 1u ) )
+    ,m_max_running( std::max( max_running, m_min_spare ) )
 {
-    for(uint32_t i = 0; i < min_spare; ++i)
+    for(uint32_t i = 0; i < m_max_running; ++i)
+    {
+        m_cpu_core_list.push_back(::std::unique_ptr<BgThread>(new BgThread(scheduler, i)));
+    }
+    assign_cores( scheduler->numa_domain_count() );
+    // threads started after m_cpu_core_list filled, because they use it to steal Tasks
+    for(uint32_t i = 0; i < m_min_spare; ++i)
     {
-        m_cpu_core_list.push_back(::std::unique_ptr<BgThread>(new BgThread(scheduler)));
+        start_thread();
     }
 }
 
 BgRunner::~BgRunner()
+{
+    stop();
+}
+/**
+ * @brief stop all BgThread's (Tasks left in queues are not run)
+ *
+ * Can be called more than once.
+ */
+void BgRunner::stop()
 {
     for( auto& core: m_cpu_core_list)
     {
         core->request_stop();
     }
+    // all threads MUST be stopped before any BgThread destroyed, because
+    // running threads can steal Tasks from other BgThread local queue
+    for( auto& core: m_cpu_core_list)
+    {
+        core->stop_thread();
+    }
+}
+/**
+ * @brief pin BgThread's to cores (if configured), set their NUMA domains and steal order
+ *
+ * With more than one NUMA domain BgThread's not pinned to cores are spread
+ * over NUMA nodes round robin and pinned to all CPUs of their node.
+ * @param domain_count Scheduler NUMA domains count
+ */
+void BgRunner::assign_cores( uint32_t domain_count )
+{
+    ThreadAffinity affinity;
+    std::vector<uint32_t> cpus;
+    {
+        std::lock_guard<std::mutex> lock( affinity_mutex );
+        affinity = thread_affinity;
+        cpus     = affinity_cpus;
+    }
+    const CpuTopology& topology = CpuTopology::instance();
+    std::vector<uint32_t> cores;
+    std::vector<uint32_t> nodes;
+    for( uint32_t core = 0; core < topology.core_count(); ++core )
+    {
+        const auto& core_cpus = topology.core_cpus( core );
+        if( cpus.empty()
+                || std::find_first_of( core_cpus.begin(), core_cpus.end()
+                                       ,cpus.begin(), cpus.end() ) != core_cpus.end() )
+        {
+            cores.push_back( core );
+            if( std::find( nodes.begin(), nodes.end(), topology.numa_node( core ) ) == nodes.end() )
+            {
+                nodes.push_back( topology.numa_node( core ) );
+            }
+        }
+    }
+    const bool pinned = ( affinity == ThreadAffinity::PerCore && !cores.empty() );
+    for( auto& thread: m_cpu_core_list )
+    {
+        const int32_t core = pinned ? int32_t( cores[ thread->index() % cores.size() ] ) : -1;
+        thread->set_core( core );
+        if( domain_count > 1 && !nodes.empty() )
+        {
+            const uint32_t node = pinned ? topology.numa_node( uint32_t( core ) )
+                                         : nodes[ thread->index() % nodes.size() ];
+            thread->set_numa_domain( node % domain_count, pinned ? -1 : int32_t( node ) );
+        }
+        else
+        {
+            thread->set_numa_domain( 0, -1 );
+        }
+    }
+    // BgThread's of other NUMA domain are stolen from after all local ones
+    const uint32_t other_domain = uint32_t( CpuTopology::OtherNode ) + 1;
+    for( auto& thief: m_cpu_core_list )
+    {
+        std::map<uint32_t, std::vector<uint32_t>> groups; // distance -> victims
+        for( auto& victim: m_cpu_core_list )
+        {
+            if( victim == thief )
+            {
+                continue;
+            }
+            uint32_t distance = pinned
+                    ? topology.distance( thief->core(), victim->core() )
+                    : uint32_t( CpuTopology::SameNumaNode );
+            if( victim->numa_domain() != thief->numa_domain() )
+            {
+                distance = other_domain;
+            }
+            groups[ distance ].push_back( victim->index() );
+        }
+        std::vector<std::vector<uint32_t>> victim_groups;
+        uint32_t local_group_count = 0;
+        for( auto& group: groups )
+        {
+            if( group.first < other_domain )
+            {
+                ++local_group_count;
+            }
+            victim_groups.push_back( std::move( group.second ) );
+        }
+        thief->set_victim_groups( std::move( victim_groups ), local_group_count );
+    }
 }
 /**
  * @brief wake up all sleeping BgThread's
  */
 void BgRunner::notify_all()
 {
-    if( BgThread::sleep_count() )
+    if( sleep_count() != 0 )
     {
         for( auto& core: m_cpu_core_list)
         {
@@ -65,18 +194,344 @@ void BgRunner::notify_all()
 /**
  * @brief notify BgRunner, that there is more Task s in RunningQueue
  *
- * If some BgThread is sleeping, one will be woked up
+ * Does nothing if some BgThread is spinning (it will find Task). Else single
+ * parked BgThread will be woken up (or started again if it retired), if
+ * nobody parked pool may grow. So at most one FUTEX_WAKE per call.
  */
 void BgRunner::notify()
 {
-    if( BgThread::sleep_count() )
+    // pairs with fence in park(): either parked BgThread sees new Task
+    // or we see it in idle stack (or spinning)
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( m_spinning_count.load( std::memory_order_relaxed ) != 0 )
     {
-        // FIXME: only single CpuCore need to by notifyed here
-        for( auto& core: m_cpu_core_list)
+        return;
+    }
+    while( BgThread* thread = pop_idle() )
+    {
+        thread->in_idle_stack().store( false, std::memory_order_seq_cst );
+        if( thread->is_active() )
         {
-            core->wake_up();
+            thread->wake_up();
+            return;
+        }
+        // BgThread retired (or retiring) while parked, start it again
+        if( start_thread( thread ) )
+        {
+            return;
+        }
+        if( thread->is_active() ) // retiring BgThread decided to continue
+        {
+            thread->wake_up();
+            return;
+        }
+    }
+    grow();
+}
+/**
+ * @brief BgThread wants to look for Task, notify() will not wake up others
+ *
+ * Keeps invariant: no more than max_spinning_threads() spinning BgThread's.
+ * @return true if BgThread can spin (MUST call end_spinning() after)
+ */
+bool BgRunner::try_begin_spinning() noexcept
+{
+    const uint32_t max_spinning = max_spinning_threads();
+    uint32_t spinning = m_spinning_count.load( std::memory_order_relaxed );
+    do
+    {
+        if( spinning >= max_spinning )
+        {
+            return false;
+        }
+    } while( !m_spinning_count.compare_exchange_weak( spinning, spinning + 1
+                                                      ,std::memory_order_seq_cst
+                                                      ,std::memory_order_relaxed ) );
+    return true;
+}
+/**
+ * @brief get max spinning BgThread count
+ * @return value set by set_spin_limits() or half of running BgThread's (at least 1)
+ */
+uint32_t BgRunner::max_spinning_threads() const noexcept
+{
+    uint32_t max_spinning = spinning_threads.load( std::memory_order_relaxed );
+    if( max_spinning == 0 )
+    {
+        max_spinning = std::max( m_running_count.load( std::memory_order_relaxed ) / 2, 1u );
+    }
+    return max_spinning;
+}
+/**
+ * @brief push parked BgThread in idle stack (if it is not there already)
+ * @param thread current BgThread going to sleep
+ */
+void BgRunner::park( BgThread* thread ) noexcept
+{
+    if( !thread->in_idle_stack().load( std::memory_order_acquire ) )
+    {
+        thread->in_idle_stack().store( true, std::memory_order_relaxed );
+        uint64_t head = m_idle_head.load( std::memory_order_relaxed );
+        uint64_t new_head;
+        do
+        {
+            thread->next_idle().store( static_cast<uint32_t>( head ), std::memory_order_relaxed );
+            new_head = ( ( ( head >> 32 ) + 1 ) << 32 ) | ( thread->index() + 1 );
+        } while( !m_idle_head.compare_exchange_weak( head, new_head
+                                                     ,std::memory_order_release
+                                                     ,std::memory_order_relaxed ) );
+    }
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+}
+/**
+ * @brief pop BgThread from idle stack
+ * @return BgThread* or nullptr if idle stack is empty
+ */
+BgThread* BgRunner::pop_idle() noexcept
+{
+    uint64_t head = m_idle_head.load( std::memory_order_acquire );
+    while( static_cast<uint32_t>( head ) != 0 )
+    {
+        BgThread* thread = m_cpu_core_list[ static_cast<uint32_t>( head ) - 1 ].get();
+        uint64_t next = thread->next_idle().load( std::memory_order_relaxed );
+        uint64_t new_head = ( ( ( head >> 32 ) + 1 ) << 32 ) | next;
+        if( m_idle_head.compare_exchange_weak( head, new_head
+                                               ,std::memory_order_acq_rel
+                                               ,std::memory_order_acquire ) )
+        {
+            return thread;
         }
     }
+    return nullptr;
+}
+/**
+ * @brief start one more BgThread if all running stay busy longer than GROW_DELAY_NS
+ */
+void BgRunner::grow() noexcept
+{
+    if( m_running_count.load( std::memory_order_acquire ) >= m_max_running )
+    {
+        return;
+    }
+    int64_t now   = now_ns();
+    int64_t since = m_backlog_since_ns.load( std::memory_order_relaxed );
+    if( since == 0 )
+    {
+        m_backlog_since_ns.compare_exchange_strong( since, now, std::memory_order_relaxed );
+        return;
+    }
+    if( now - since < GROW_DELAY_NS
+            || !m_backlog_since_ns.compare_exchange_strong( since, now
+                                                            ,std::memory_order_relaxed ) )
+    {
+        return; // not long enough or other thread is starting BgThread
+    }
+    start_thread();
+}
+/**
+ * @brief start OS thread for some not running BgThread
+ * @return true if new thread started
+ */
+bool BgRunner::start_thread() noexcept
+{
+    uint32_t running = m_running_count.load( std::memory_order_acquire );
+    do
+    {
+        if( running >= m_max_running )
+        {
+            return false;
+        }
+    } while( !m_running_count.compare_exchange_weak( running, running + 1
+                                                     ,std::memory_order_acq_rel ) );
+    for( auto& core: m_cpu_core_list )
+    {
+        if( core->try_activate() )
+        {
+            try
+            {
+                core->start();
+                return true;
+            }
+            catch( const std::system_error& )
+            {
+                core->deactivate();
+                break;
+            }
+        }
+    }
+    m_running_count.fetch_sub( 1, std::memory_order_acq_rel );
+    return false;
+}
+/**
+ * @brief start OS thread for given not running BgThread
+ * @param thread BgThread to start
+ * @return true if thread started, false if it is active already (or start failed)
+ */
+bool BgRunner::start_thread( BgThread* thread ) noexcept
+{
+    if( !thread->try_activate() )
+    {
+        return false;
+    }
+    m_running_count.fetch_add( 1, std::memory_order_acq_rel );
+    try
+    {
+        thread->start();
+        return true;
+    }
+    catch( const std::system_error& )
+    {
+        thread->deactivate();
+        m_running_count.fetch_sub( 1, std::memory_order_acq_rel );
+        return false;
+    }
+}
+/**
+ * @brief ask permission to retire idle BgThread
+ *
+ * BgThread MUST check running queues once more after successful try_retire()
+ * and call cancel_retire() if it found some Task.
+ * @return true if BgThread can stop (more than min_spare running)
+ */
+bool BgRunner::try_retire() noexcept
+{
+    uint32_t running = m_running_count.load( std::memory_order_acquire );
+    do
+    {
+        if( running <= m_min_spare )
+        {
+            return false;
+        }
+    } while( !m_running_count.compare_exchange_weak( running, running - 1
+                                                     ,std::memory_order_acq_rel ) );
+    return true;
+}
+/**
+ * @brief BgThread found Task after try_retire() and continue running
+ */
+void BgRunner::cancel_retire() noexcept
+{
+    m_running_count.fetch_add( 1, std::memory_order_acq_rel );
+}
+/**
+ * @brief get min_spare for next created BgRunner
+ * @return always running BgThread count
+ */
+uint32_t BgRunner::default_min_spare() noexcept
+{
+    return min_spare_threads.load( std::memory_order_acquire );
+}
+/**
+ * @brief get max_running for next created BgRunner
+ * @return max BgThread count (std::thread::hardware_concurrency() if not set)
+ */
+uint32_t BgRunner::default_max_running() noexcept
+{
+    uint32_t max_running = max_running_threads.load( std::memory_order_acquire );
+    if( max_running == 0 )
+    {
+        max_running = std::max( std::thread::hardware_concurrency(), 1u );
+    }
+    return max_running;
+}
+/**
+ * @brief set BgThread pool limits
+ *
+ * MUST be called before Scheduler first used (before first Task created),
+ * because BgRunner is created with Scheduler.
+ * @param min_spare always running BgThread count (at least 1)
+ * @param max_running max BgThread count (0 - std::thread::hardware_concurrency())
+ */
+void BgRunner::set_thread_limits( uint32_t min_spare, uint32_t max_running ) noexcept
+{
+    min_spare_threads.store( min_spare, std::memory_order_release );
+    max_running_threads.store( max_running, std::memory_order_release );
+}
+/**
+ * @brief get idle timeout after which not needed BgThread retires
+ * @return idle timeout
+ */
+std::chrono::milliseconds BgRunner::idle_timeout() noexcept
+{
+    return std::chrono::milliseconds( idle_timeout_ms.load( std::memory_order_relaxed ) );
+}
+/**
+ * @brief set idle timeout after which not needed BgThread retires
+ * @param timeout idle timeout
+ */
+void BgRunner::set_idle_timeout( std::chrono::milliseconds timeout ) noexcept
+{
+    idle_timeout_ms.store( timeout.count(), std::memory_order_relaxed );
+}
+/**
+ * @brief steal Task from local queue of some other BgThread
+ *
+ * Victims are checked by groups, closest (by cache sharing) group first.
+ * Inside group victims are checked starting from random one, so thieves
+ * do not contend on the same victim.
+ * @param thief BgThread looking for Task
+ * @param other_domains false to steal from BgThread's of thief NUMA domain,
+ * true - from BgThread's of other NUMA domains
+ * @return stolen Task* or nullptr if all checked local queues are empty
+ */
+TaskBase* BgRunner::steal( BgThread* thief, bool other_domains ) noexcept
+{
+    const auto& groups = thief->victim_groups();
+    const size_t local_count = thief->local_group_count();
+    const size_t begin = other_domains ? local_count : 0;
+    const size_t end   = other_domains ? groups.size() : local_count;
+    for( size_t group_index = begin; group_index < end; ++group_index )
+    {
+        const auto& group = groups[ group_index ];
+        const size_t count = group.size();
+        size_t start = thief->next_random() % count;
+        for( size_t i = 0; i < count; ++i )
+        {
+            BgThread* victim = m_cpu_core_list[ group[ ( start + i ) % count ] ].get();
+            TaskBase* task = victim->local_queue().steal();
+            if( task != nullptr )
+            {
+                return task;
+            }
+        }
+    }
+    return nullptr;
+}
+/**
+ * @brief get max spin iterations before BgThread parks
+ * @return max spin iterations (0 - BgThread parks without spinning)
+ */
+uint32_t BgRunner::max_spin_iterations() noexcept
+{
+    return spin_iterations.load( std::memory_order_relaxed );
+}
+/**
+ * @brief set spin phase limits of idle BgThread's
+ *
+ * Can be changed at any time.
+ * @param max_spin_iterations max run queues polls before park (0 - do not spin)
+ * @param max_spinning_threads max BgThread's spinning at the same time
+ * (0 - half of running BgThread's, at least 1)
+ */
+void BgRunner::set_spin_limits( uint32_t max_spin_iterations
+                                ,uint32_t max_spinning_threads ) noexcept
+{
+    spin_iterations.store( max_spin_iterations, std::memory_order_relaxed );
+    spinning_threads.store( max_spinning_threads, std::memory_order_relaxed );
+}
+
+/**
+ * @brief set BgThread CPU affinity
+ *
+ * MUST be called before Scheduler first used (before first Task created).
+ * @param affinity ThreadAffinity::None or ThreadAffinity::PerCore
+ * @param cpus OS CPU indexes to use (cores with at least one of them), empty - all
+ */
+void BgRunner::set_thread_affinity( ThreadAffinity affinity, const std::vector<uint32_t>& cpus )
+{
+    std::lock_guard<std::mutex> lock( affinity_mutex );
+    thread_affinity = affinity;
+    affinity_cpus   = cpus;
 }
 
 }
@@ -19,22 +19,46 @@
 
 #include "alterstack/bg_thread.hpp"
 
-#include "alterstack/atomic_guard.hpp"
+#include <algorithm>
+#include <cassert>
+
 #include "alterstack/bg_runner.hpp"
+#include "alterstack/cpu_topology.hpp"
 #include "alterstack/scheduler.hpp"
 #include "alterstack/task.hpp"
 #include "alterstack/task_runner.hpp"
 #include "alterstack/os_utils.hpp"
+#include "alterstack/spin_lock.hpp"
 
 namespace alterstack
 {
-::std::atomic<uint32_t> BgThread::m_sleep_count;
-
+/**
+ * @brief OS thread function: join retired OS thread of this BgThread, run
+ * Tasks until stopped or retired
+ */
 void BgThread::thread_function()
 {
-    AtomicReturnBoolGuard thread_stopped_guard(m_thread_stopped);
-    TaskRunner::current().make_bg_runner({});
+    if( m_retired_thread.joinable() )
+    {
+        m_retired_thread.join();
+    }
+    run();
+    m_thread_count.fetch_sub( 1, std::memory_order_release );
+}
+
+void BgThread::run()
+{
+    TaskRunner::current().make_bg_runner( {}, this );
     os::set_thread_name();
+    if( m_core >= 0 )
+    {
+        CpuTopology::instance().bind_current_thread( static_cast<uint32_t>( m_core ) );
+    }
+    else if( m_bind_node >= 0 )
+    {
+        CpuTopology::instance().bind_current_thread_to_node( static_cast<uint32_t>( m_bind_node ) );
+    }
+    BgRunner& runner = scheduler_->bg_runner_;
 
     while( true )
     {
@@ -42,42 +66,144 @@ void BgThread::thread_function()
         if( is_stop_requested() )
             return;
 
-        wait();
+        TaskBase* task = spin( runner );
+        if( task != nullptr )
+        {
+            Scheduler::run_task( task );
+            continue;
+        }
+
+        runner.set_idle();
+        runner.park( this );
+        if( Scheduler::schedule() ) // Task enqueued before park() could not wake us
+            continue;
+
+        if( !wait( BgRunner::idle_timeout() )
+                && runner.try_retire() )
+        {
+            deactivate();
+            // notify() could pop this BgThread from idle stack while it was
+            // retiring, then it (or this thread) must continue running
+            if( in_idle_stack().load( std::memory_order_seq_cst ) )
+                return;
+            if( !try_activate() )
+                return; // notify() will start this BgThread again
+            runner.cancel_retire();
+        }
 
         if( is_stop_requested() )
             return;
     }
 }
 
+/**
+ * @brief poll run queues before park
+ *
+ * Spin budget grows (twice) after successful spin and shrinks (twice) after
+ * failed one, so BgThread spins only while Tasks come often enough.
+ * @param runner BgRunner of this BgThread
+ * @return found Task* (spinning already stopped) or nullptr
+ */
+TaskBase* BgThread::spin( BgRunner& runner )
+{
+    const uint32_t max_budget = BgRunner::max_spin_iterations();
+    if( max_budget == 0
+            || !runner.try_begin_spinning() )
+    {
+        return nullptr;
+    }
+    const uint32_t min_budget = std::min( uint32_t{ MIN_SPIN_ITERATIONS }, max_budget );
+    m_spin_budget = std::max( std::min( m_spin_budget, max_budget ), min_budget );
+    TaskBase* task = nullptr;
+    for( uint32_t i = 0; i < m_spin_budget && !is_stop_requested(); ++i )
+    {
+        task = Scheduler::find_next_task();
+        if( task != nullptr )
+        {
+            break;
+        }
+        cpu_relax();
+    }
+    uint32_t spinning_left = runner.end_spinning();
+    if( task != nullptr )
+    {
+        m_spin_budget = std::min( m_spin_budget * 2, max_budget );
+        if( spinning_left == 0 )
+        {
+            runner.notify(); // last spinning BgThread found Task, maybe there are more
+        }
+    }
+    else
+    {
+        m_spin_budget = m_spin_budget / 2;
+    }
+    return task;
+}
+
 void BgThread::ensure_thread_stopped()
 {
-    while( !m_thread_stopped.load() )
+    while( m_thread_count.load( std::memory_order_acquire ) != 0 )
     {
         std::this_thread::sleep_for(::std::chrono::microseconds(1));
         wake_up();
     }
 }
 
-void BgThread::wait()
+/**
+ * @brief sleep until woken up or timeout
+ * @param timeout max sleep time
+ * @return false if timeout expired
+ */
+bool BgThread::wait( std::chrono::milliseconds timeout )
 {
-    m_sleep_count.fetch_add(1, std::memory_order_relaxed);
-    m_task_avalable_futex.wait();
-    m_sleep_count.fetch_sub(1, std::memory_order_relaxed);
-
+    BgRunner& runner = scheduler_->bg_runner_;
+    runner.begin_sleep();
+    bool woken_up = m_task_avalable_futex.wait_for( timeout );
+    runner.end_sleep();
+    return woken_up;
 }
 
-BgThread::BgThread(Scheduler *scheduler)
+BgThread::BgThread(Scheduler *scheduler, uint32_t index)
     :scheduler_(scheduler)
+    ,m_index(index)
+    ,m_random_state( static_cast<uint32_t>( reinterpret_cast<uintptr_t>( this ) >> 6 ) | 1 )
 {
     m_stop_requested.store(false, ::std::memory_order_relaxed);
-    m_thread_stopped.store(false, ::std::memory_order_release);
-    m_os_thread = ::std::thread(&BgThread::thread_function, this);
+}
+/**
+ * Retired OS thread (stopped or stopping now) is not joined here (start()
+ * is called from notify() hot path), new OS thread joins it before running
+ * Tasks. BgThread is retired only by running OS thread, so previous retired
+ * thread is always joined already.
+ */
+void BgThread::start()
+{
+    assert( !m_retired_thread.joinable() );
+    m_retired_thread = std::move( m_os_thread );
+    m_thread_count.fetch_add( 1, std::memory_order_acq_rel );
+    try
+    {
+        m_os_thread = ::std::thread(&BgThread::thread_function, this);
+    }
+    catch( ... )
+    {
+        m_thread_count.fetch_sub( 1, std::memory_order_acq_rel );
+        m_os_thread = std::move( m_retired_thread );
+        throw;
+    }
 }
 
 BgThread::~BgThread()
 {
     stop_thread();
-    m_os_thread.join();
+    if( m_os_thread.joinable() )
+    {
+        m_os_thread.join();
+    }
+    if( m_retired_thread.joinable() ) // new OS thread failed to start
+    {
+        m_retired_thread.join();
+    }
 }
 
 void BgThread::stop_thread()
@@ -89,7 +215,7 @@ void BgThread::stop_thread()
 
 void BgThread::wake_up()
 {
-    m_task_avalable_futex.notify_all();
+    m_task_avalable_futex.notify();
 }
 
 }
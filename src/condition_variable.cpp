@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/condition_variable.hpp"
+
+#include <cassert>
+#include <mutex>
+
+#include "alterstack/scheduler.hpp"
+#include "alterstack/task.hpp"
+
+namespace alterstack
+{
+
+ConditionVariable::~ConditionVariable()
+{
+    assert( m_data.load( std::memory_order_relaxed ).head == nullptr );
+    assert( m_fifo == nullptr );
+}
+/**
+ * @brief unlock Mutex, park current Task until notified, lock Mutex again
+ * @param lock locked Mutex
+ */
+void ConditionVariable::wait( std::unique_lock<Mutex>& lock )
+{
+    assert( lock.owns_lock() );
+    TaskBase* const current_task = Scheduler::get_current_task();
+    Scheduler::prepare_park( current_task );
+    WaitListData data = m_data.load( std::memory_order_relaxed );
+    WaitListData new_data;
+    new_data.head = current_task;
+    do
+    {
+        current_task->set_next( data.head );
+        new_data.is_fifo_used = data.is_fifo_used;
+    } while( !m_data.compare_exchange_weak( data, new_data
+                                            ,std::memory_order_release
+                                            ,std::memory_order_relaxed ) );
+    // Mutex::unlock() only wakes up other Task, current one stays parked
+    lock.unlock();
+    Scheduler::schedule( current_task );
+    lock.lock();
+}
+/**
+ * @brief wake up the oldest waiting Task (if any)
+ */
+void ConditionVariable::notify_one() noexcept
+{
+    WaitListData data = m_data.load( std::memory_order_acquire );
+    if( data.head == nullptr
+            && data.is_fifo_used == 0 )
+    {
+        return;
+    }
+    TaskBase* task = nullptr;
+    {
+        std::lock_guard<SpinLock> guard( m_notify_lock );
+        if( m_fifo == nullptr )
+        {
+            m_fifo = take_waiters();
+        }
+        task = m_fifo;
+        if( task != nullptr )
+        {
+            m_fifo = task->next();
+            if( m_fifo == nullptr )
+            {   // move new waiters (or clear is_fifo_used if there are none)
+                m_fifo = take_waiters();
+            }
+        }
+    }
+    if( task != nullptr )
+    {
+        task->set_next( nullptr );
+        Scheduler::add_waiting_list_to_running( task );
+    }
+}
+/**
+ * @brief wake up all waiting Tasks
+ */
+void ConditionVariable::notify_all() noexcept
+{
+    WaitListData data = m_data.load( std::memory_order_acquire );
+    if( data.head == nullptr
+            && data.is_fifo_used == 0 )
+    {
+        return;
+    }
+    TaskBase* fifo = nullptr;
+    TaskBase* stack = nullptr;
+    {
+        std::lock_guard<SpinLock> guard( m_notify_lock );
+        fifo = m_fifo;
+        m_fifo = nullptr;
+        data = m_data.exchange( WaitListData{ nullptr, 0 }, std::memory_order_acq_rel );
+        stack = data.head;
+    }
+    if( fifo != nullptr )
+    {
+        Scheduler::add_waiting_list_to_running( fifo );
+    }
+    if( stack != nullptr )
+    {
+        Scheduler::add_waiting_list_to_running( stack );
+    }
+}
+/**
+ * @brief take all waiters from m_data
+ *
+ * m_notify_lock MUST be locked and m_fifo empty. is_fifo_used is set if
+ * waiters are taken (they go to m_fifo) and cleared otherwise.
+ * @return waiters list in wait() order (oldest first) or nullptr
+ */
+TaskBase* ConditionVariable::take_waiters() noexcept
+{
+    WaitListData data = m_data.load( std::memory_order_acquire );
+    WaitListData new_data;
+    do
+    {
+        new_data.head = nullptr;
+        new_data.is_fifo_used = ( data.head != nullptr ) ? 1 : 0;
+    } while( !m_data.compare_exchange_weak( data, new_data
+                                            ,std::memory_order_acq_rel
+                                            ,std::memory_order_acquire ) );
+    // waiters stack is newest first, reverse it
+    TaskBase* fifo = nullptr;
+    TaskBase* task = data.head;
+    while( task != nullptr )
+    {
+        TaskBase* next = task->next();
+        task->set_next( fifo );
+        fifo = task;
+        task = next;
+    }
+    return fifo;
+}
+
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "alterstack/cpu_topology.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+
+#ifdef ALTERSTACK_USE_HWLOC
+#include <hwloc.h>
+#endif
+
+namespace alterstack
+{
+/**
+ * @brief get CpuTopology singleton (detected at first call)
+ * @return CpuTopology reference
+ */
+const CpuTopology& CpuTopology::instance()
+{
+    static CpuTopology topology;
+    return topology;
+}
+
+CpuTopology::CpuTopology()
+{
+    if( !detect_hwloc() )
+    {
+        detect_flat();
+    }
+    for( const Core& core: m_cores )
+    {
+        for( uint32_t cpu: core.cpus )
+        {
+            if( cpu >= m_cpu_nodes.size() )
+            {
+                m_cpu_nodes.resize( cpu + 1, 0 );
+            }
+            m_cpu_nodes[ cpu ] = core.numa_node;
+        }
+    }
+}
+
+CpuTopology::~CpuTopology()
+{
+#ifdef ALTERSTACK_USE_HWLOC
+    if( m_hwloc != nullptr )
+    {
+        hwloc_topology_destroy( m_hwloc );
+    }
+#endif
+}
+/**
+ * @brief detect physical cores, shared caches and NUMA nodes with hwloc
+ * @return false if hwloc is not used or detection failed
+ */
+bool CpuTopology::detect_hwloc()
+{
+#ifdef ALTERSTACK_USE_HWLOC
+    hwloc_topology_t topology;
+    if( hwloc_topology_init( &topology ) != 0 )
+    {
+        return false;
+    }
+    if( hwloc_topology_load( topology ) != 0 )
+    {
+        hwloc_topology_destroy( topology );
+        return false;
+    }
+    hwloc_bitmap_t allowed = hwloc_bitmap_alloc();
+    if( hwloc_get_cpubind( topology, allowed, HWLOC_CPUBIND_PROCESS ) != 0 )
+    {
+        hwloc_bitmap_copy( allowed, hwloc_topology_get_allowed_cpuset( topology ) );
+    }
+    const int core_count = hwloc_get_nbobjs_by_type( topology, HWLOC_OBJ_CORE );
+    for( int i = 0; i < core_count; ++i )
+    {
+        hwloc_obj_t core_obj = hwloc_get_obj_by_type( topology, HWLOC_OBJ_CORE, i );
+        Core core;
+        int cpu = -1;
+        while( ( cpu = hwloc_bitmap_next( core_obj->cpuset, cpu ) ) != -1 )
+        {
+            if( hwloc_bitmap_isset( allowed, cpu ) )
+            {
+                core.cpus.push_back( static_cast<uint32_t>( cpu ) );
+            }
+        }
+        if( core.cpus.empty() )
+        {
+            continue;
+        }
+        for( hwloc_obj_t parent = core_obj->parent; parent != nullptr; parent = parent->parent )
+        {
+#if HWLOC_API_VERSION >= 0x00020000
+            if( parent->type == HWLOC_OBJ_L2CACHE && core.l2_cache < 0 )
+                core.l2_cache = static_cast<int32_t>( parent->logical_index );
+            if( parent->type == HWLOC_OBJ_L3CACHE && core.l3_cache < 0 )
+                core.l3_cache = static_cast<int32_t>( parent->logical_index );
+#else
+            if( parent->type == HWLOC_OBJ_CACHE && parent->attr->cache.depth == 2 && core.l2_cache < 0 )
+                core.l2_cache = static_cast<int32_t>( parent->logical_index );
+            if( parent->type == HWLOC_OBJ_CACHE && parent->attr->cache.depth == 3 && core.l3_cache < 0 )
+                core.l3_cache = static_cast<int32_t>( parent->logical_index );
+#endif
+        }
+        hwloc_obj_t node = hwloc_get_next_obj_covering_cpuset_by_type(
+                    topology, core_obj->cpuset, HWLOC_OBJ_NUMANODE, nullptr );
+        if( node == nullptr )
+        {
+            node = hwloc_get_next_obj_inside_cpuset_by_type(
+                        topology, core_obj->cpuset, HWLOC_OBJ_NUMANODE, nullptr );
+        }
+        core.numa_node = ( node != nullptr ) ? node->logical_index : 0;
+        m_numa_node_count = std::max( m_numa_node_count, core.numa_node + 1 );
+        m_cores.push_back( std::move( core ) );
+    }
+    hwloc_bitmap_free( allowed );
+    m_is_detected = !m_cores.empty();
+    if( m_is_detected )
+    {
+        m_hwloc = topology;
+    }
+    else
+    {
+        hwloc_topology_destroy( topology );
+    }
+    return m_is_detected;
+#else
+    return false;
+#endif
+}
+/**
+ * @brief each CPU available to process is separate core without shared caches
+ */
+void CpuTopology::detect_flat()
+{
+    m_cores.clear();
+    m_numa_node_count = 1;
+    cpu_set_t cpu_set;
+    CPU_ZERO( &cpu_set );
+    if( ::sched_getaffinity( 0, sizeof(cpu_set), &cpu_set ) == 0 )
+    {
+        for( uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+        {
+            if( CPU_ISSET( cpu, &cpu_set ) )
+            {
+                Core core;
+                core.cpus.push_back( cpu );
+                m_cores.push_back( std::move( core ) );
+            }
+        }
+    }
+    if( m_cores.empty() )
+    {
+        Core core;
+        core.cpus.push_back( 0 );
+        m_cores.push_back( std::move( core ) );
+    }
+}
+/**
+ * @brief get distance between cores
+ * @param core_a first core
+ * @param core_b second core
+ * @return Distance (SameCore if core_a == core_b)
+ */
+CpuTopology::Distance CpuTopology::distance( uint32_t core_a, uint32_t core_b ) const noexcept
+{
+    const Core& a = m_cores[ core_a ];
+    const Core& b = m_cores[ core_b ];
+    if( core_a == core_b )
+        return SameCore;
+    if( a.l2_cache >= 0 && a.l2_cache == b.l2_cache )
+        return SharedL2;
+    if( a.l3_cache >= 0 && a.l3_cache == b.l3_cache )
+        return SharedL3;
+    if( a.numa_node == b.numa_node )
+        return SameNumaNode;
+    return OtherNode;
+}
+/**
+ * @brief bind current OS thread to CPUs of core
+ * @param core core index
+ * @return true on success
+ */
+bool CpuTopology::bind_current_thread( uint32_t core ) const noexcept
+{
+    if( core >= m_cores.size() )
+    {
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO( &cpu_set );
+    for( uint32_t cpu: m_cores[ core ].cpus )
+    {
+        CPU_SET( cpu, &cpu_set );
+    }
+    return ::pthread_setaffinity_np( ::pthread_self(), sizeof(cpu_set), &cpu_set ) == 0;
+}
+
+/**
+ * @brief bind current OS thread to all CPUs of NUMA node
+ * @param node NUMA node index
+ * @return true on success
+ */
+bool CpuTopology::bind_current_thread_to_node( uint32_t node ) const noexcept
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO( &cpu_set );
+    bool has_cpu = false;
+    for( const Core& core: m_cores )
+    {
+        if( core.numa_node != node )
+        {
+            continue;
+        }
+        for( uint32_t cpu: core.cpus )
+        {
+            CPU_SET( cpu, &cpu_set );
+            has_cpu = true;
+        }
+    }
+    if( !has_cpu )
+    {
+        return false;
+    }
+    return ::pthread_setaffinity_np( ::pthread_self(), sizeof(cpu_set), &cpu_set ) == 0;
+}
+/**
+ * @brief get NUMA node of CPU current thread is running on
+ * @return NUMA node (0 if unknown)
+ */
+uint32_t CpuTopology::current_numa_node() const noexcept
+{
+    if( m_numa_node_count == 1 )
+    {
+        return 0;
+    }
+    int cpu = ::sched_getcpu();
+    return cpu < 0 ? 0 : cpu_numa_node( static_cast<uint32_t>( cpu ) );
+}
+/**
+ * @brief bind memory pages of range to NUMA node
+ *
+ * MUST be called before pages are touched (already faulted pages are not moved).
+ * Works with hwloc only, without it there is single NUMA node anyway.
+ * @param address range start (page aligned)
+ * @param size range size
+ * @param node NUMA node index
+ * @return true on success
+ */
+bool CpuTopology::bind_memory( void* address, size_t size, uint32_t node ) const noexcept
+{
+#ifdef ALTERSTACK_USE_HWLOC
+    if( m_hwloc == nullptr || m_numa_node_count == 1 )
+    {
+        return false;
+    }
+    hwloc_obj_t node_obj = hwloc_get_obj_by_type( m_hwloc, HWLOC_OBJ_NUMANODE, node );
+    if( node_obj == nullptr )
+    {
+        return false;
+    }
+#if HWLOC_API_VERSION >= 0x00020000
+    return hwloc_set_area_membind( m_hwloc, address, size, node_obj->nodeset
+                                   ,HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_BYNODESET ) == 0;
+#else
+    return hwloc_set_area_membind_nodeset( m_hwloc, address, size, node_obj->nodeset
+                                           ,HWLOC_MEMBIND_BIND, 0 ) == 0;
+#endif
+#else
+    (void)address;
+    (void)size;
+    (void)node;
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/event.hpp"
+
+#include <cassert>
+
+#include "alterstack/scheduler.hpp"
+#include "alterstack/task.hpp"
+
+namespace alterstack
+{
+
+Event::Event( bool is_set ) noexcept
+    :m_data{}
+{
+    Awaitable::AwaitableData aw_data;
+    aw_data.is_finished = is_set;
+    m_data.store( aw_data, std::memory_order_relaxed );
+}
+
+Event::~Event()
+{
+    assert( m_data.load( std::memory_order_relaxed ).head == nullptr );
+}
+/**
+ * @brief park current Task until Event is set
+ */
+void Event::wait()
+{
+    if( Awaitable::insert_current_task_in_waitlist( m_data ) )
+    {
+        Scheduler::schedule();
+    }
+}
+/**
+ * @brief set Event and wake up all waiting Tasks
+ */
+void Event::set() noexcept
+{
+    Awaitable::AwaitableData aw_data = m_data.load( std::memory_order_acquire );
+    Awaitable::AwaitableData new_aw_data;
+    new_aw_data.is_finished = true;
+    do
+    {
+        if( aw_data.is_finished )
+        {
+            return;
+        }
+    } while( !m_data.compare_exchange_weak( aw_data, new_aw_data
+                                            ,std::memory_order_acq_rel
+                                            ,std::memory_order_acquire ) );
+    if( aw_data.head != nullptr )
+    {
+        Scheduler::add_waiting_list_to_running( aw_data.head );
+    }
+}
+/**
+ * @brief return set Event to not set state, does nothing if it is not set
+ */
+void Event::reset() noexcept
+{
+    // expected value is always loaded from m_data, so padding bytes match
+    Awaitable::AwaitableData aw_data = m_data.load( std::memory_order_relaxed );
+    Awaitable::AwaitableData new_aw_data;
+    while( aw_data.is_finished )
+    {
+        if( m_data.compare_exchange_weak( aw_data, new_aw_data
+                                          ,std::memory_order_release
+                                          ,std::memory_order_relaxed ) )
+        {
+            return;
+        }
+    }
+}
+
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/mutex.hpp"
+
+#include <cassert>
+
+#include "alterstack/scheduler.hpp"
+#include "alterstack/spin_lock.hpp"
+#include "alterstack/task.hpp"
+
+namespace alterstack
+{
+
+Mutex::~Mutex()
+{
+    assert( m_state.load( std::memory_order_relaxed ) == 0 );
+    assert( m_fifo == nullptr );
+}
+/**
+ * @brief lock Mutex, park current Task while it is locked by other Task
+ */
+void Mutex::lock()
+{
+    uintptr_t expected = 0;
+    if( m_state.compare_exchange_strong( expected, LOCKED
+                                         ,std::memory_order_acquire
+                                         ,std::memory_order_relaxed ) )
+    {
+        return;
+    }
+    for( uint32_t i = 0; i < SPIN_COUNT; ++i )
+    {
+        if( try_lock() )
+        {
+            return;
+        }
+        cpu_relax();
+    }
+    TaskBase* const current_task = Scheduler::get_current_task();
+    while( true )
+    {
+        uintptr_t state = m_state.load( std::memory_order_relaxed );
+        if( ( state & LOCKED ) == 0 )
+        {
+            if( m_state.compare_exchange_weak( state, state | LOCKED
+                                               ,std::memory_order_acquire
+                                               ,std::memory_order_relaxed ) )
+            {
+                return;
+            }
+            continue;
+        }
+        if( try_park( current_task, state ) )
+        {
+            // unlock() handed Mutex over to us and made us Running
+            Scheduler::schedule( current_task );
+            return;
+        }
+    }
+}
+/**
+ * @brief push current Task in waiters stack of locked Mutex
+ *
+ * Task is marked Waiting before push (like Awaitable::wait()), unlock() can
+ * wake it up right after push, before current thread switched it out.
+ * @param task current Task
+ * @param state Mutex state with LOCKED flag set
+ * @return true if Task is in waiters stack, false if state changed
+ */
+bool Mutex::try_park( TaskBase* task, uintptr_t state ) noexcept
+{
+    Scheduler::prepare_park( task );
+    task->set_next( reinterpret_cast<TaskBase*>( state & ~LOCKED ) );
+    if( m_state.compare_exchange_strong( state, reinterpret_cast<uintptr_t>( task ) | LOCKED
+                                         ,std::memory_order_release
+                                         ,std::memory_order_relaxed ) )
+    {
+        return true;
+    }
+    task->set_next( nullptr );
+    Scheduler::cancel_park( task );
+    return false;
+}
+/**
+ * @brief unlock Mutex or hand it over to the oldest waiting Task
+ *
+ * Waiters are served in FIFO order: when owner's FIFO list is empty, whole
+ * waiters stack is taken by the same CAS which keeps Mutex locked, and
+ * reversed. m_fifo is used by Mutex owner only (it is passed over with
+ * Mutex), so it needs no synchronization.
+ */
+void Mutex::unlock() noexcept
+{
+    TaskBase* waiter = m_fifo;
+    if( waiter == nullptr )
+    {
+        uintptr_t state = m_state.load( std::memory_order_acquire );
+        while( true )
+        {
+            assert( ( state & LOCKED ) != 0 );
+            // no waiters - unlock, otherwise take them all and keep Mutex locked
+            const uintptr_t new_state = ( state == LOCKED ) ? 0 : LOCKED;
+            if( m_state.compare_exchange_weak( state, new_state
+                                               ,std::memory_order_acq_rel
+                                               ,std::memory_order_acquire ) )
+            {
+                break;
+            }
+        }
+        if( state == LOCKED )
+        {
+            return;
+        }
+        // waiters stack is newest first, reverse it
+        TaskBase* task = reinterpret_cast<TaskBase*>( state & ~LOCKED );
+        while( task != nullptr )
+        {
+            TaskBase* next = task->next();
+            task->set_next( waiter );
+            waiter = task;
+            task = next;
+        }
+    }
+    m_fifo = waiter->next();
+    waiter->set_next( nullptr );
+    Scheduler::add_waiting_list_to_running( waiter );
+}
+
+}
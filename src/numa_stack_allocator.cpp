@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/numa_stack_allocator.hpp"
+
+#include "alterstack/cpu_topology.hpp"
+
+namespace alterstack
+{
+/**
+ * @brief create SlabStackAllocator for each NUMA node of CpuTopology
+ * @param slab_size slab size of each node allocator
+ * @param pages slab memory pages type
+ */
+NumaStackAllocator::NumaStackAllocator( size_t slab_size, SlabPages pages )
+{
+    const uint32_t node_count = CpuTopology::instance().numa_node_count();
+    for( uint32_t node = 0; node < node_count; ++node )
+    {
+        m_node_allocators.push_back( std::unique_ptr<SlabStackAllocator>(
+                                         new SlabStackAllocator( slab_size, pages ) ) );
+        m_node_allocators.back()->set_numa_node( static_cast<int32_t>( node ) );
+    }
+}
+/**
+ * @brief allocate Stack from current NUMA node allocator
+ * @param size_class stack size class (StackSize::Default allowed)
+ * @param guard stack guard mode
+ * @return Stack* with allocator() == node allocator, throws std::bad_alloc on failure
+ */
+Stack* NumaStackAllocator::allocate( StackSize size_class, StackGuard guard )
+{
+    uint32_t node = CpuTopology::instance().current_numa_node();
+    if( node >= m_node_allocators.size() )
+    {
+        node = 0;
+    }
+    return m_node_allocators[ node ]->allocate( size_class, guard );
+}
+/**
+ * @brief give Stack back to it's node allocator
+ * @param stack Stack* allocated by this allocator
+ */
+void NumaStackAllocator::deallocate( Stack* stack ) noexcept
+{
+    stack->allocator()->deallocate( stack );
+}
+
+}
@@ -19,6 +19,8 @@
 
 #include "alterstack/scheduler.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <thread>
 
@@ -26,6 +28,10 @@
 #include "alterstack/spin_lock.hpp"
 #include "alterstack/context.hpp"
 #include "alterstack/bg_runner.hpp"
+#include "alterstack/cpu_topology.hpp"
+#include "alterstack/numa_stack_allocator.hpp"
+#include "alterstack/slab_stack_allocator.hpp"
+#include "alterstack/stack_pool.hpp"
 #include "alterstack/task_runner.hpp"
 
 namespace alterstack
@@ -33,10 +39,192 @@ namespace alterstack
 
 namespace ctx = ::scontext;
 
-Scheduler::Scheduler()
-    :running_queue_()
-    ,bg_runner_( this )
+const Context Scheduler::WAKEUP_PENDING = reinterpret_cast<Context>( uintptr_t{ 0x02 } );
+const Context Scheduler::PARK_CANCELLED = reinterpret_cast<Context>( uintptr_t{ 0x01 } );
+
+namespace
+{
+std::atomic<bool> numa_domains{ false };
+
+uint32_t numa_domain_count_to_use( uint32_t max_domains ) noexcept
+{
+    if( !numa_domains.load( std::memory_order_acquire ) )
+    {
+        return 1;
+    }
+    return std::min( CpuTopology::instance().numa_node_count(), max_domains );
+}
+/**
+ * @brief create Stack pool owned by Scheduler
+ *
+ * Default Scheduler uses process wide default StackAllocator, so it needs
+ * own pool for NUMA domains only.
+ * @param is_default true for default Scheduler
+ * @return new StackAllocator or nullptr
+ */
+StackAllocator* new_stack_allocator( bool is_default )
+{
+    if( numa_domains.load( std::memory_order_acquire ) )
+    {
+        return new NumaStackAllocator();
+    }
+    return is_default ? nullptr : new SlabStackAllocator();
+}
+}
+/**
+ * @brief create Scheduler with it's own BgRunner, running queues and Stack pool
+ * @param min_spare BgThread's running always (see BgRunner)
+ * @param max_running max BgThread count
+ * @param stack_allocator StackAllocator for Task s of this Scheduler, nullptr -
+ * own SlabStackAllocator (NumaStackAllocator with NUMA domains)
+ */
+Scheduler::Scheduler( uint32_t min_spare, uint32_t max_running, StackAllocator* stack_allocator )
+    :Scheduler( min_spare, max_running, stack_allocator, false )
 {}
+
+Scheduler::Scheduler( uint32_t min_spare, uint32_t max_running
+                      ,StackAllocator* stack_allocator, bool is_default )
+    :is_default_( is_default )
+    ,domain_count_( numa_domain_count_to_use( MAX_NUMA_DOMAINS ) )
+    ,running_queues_()
+    ,own_stack_allocator_( stack_allocator == nullptr ? new_stack_allocator( is_default ) : nullptr )
+    ,stack_allocator_( ( stack_allocator != nullptr || is_default )
+                       ? stack_allocator : own_stack_allocator_.get() )
+    ,bg_runner_( this, min_spare, max_running )
+{
+    // do not override allocator set by user
+    if( is_default_
+            && own_stack_allocator_
+            && StackAllocator::default_allocator() == &StackPool::instance() )
+    {
+        StackAllocator::set_default_allocator( own_stack_allocator_.get() );
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    wait_detached_tasks();
+    // BgThreads still finishing Tasks use stack allocators, stop them first
+    bg_runner_.stop();
+    if( own_stack_allocator_
+            && StackAllocator::default_allocator() == own_stack_allocator_.get() )
+    {
+        StackAllocator::set_default_allocator( nullptr );
+    }
+}
+/**
+ * @brief wait until all detached Tasks of this Scheduler finished and destroyed
+ *
+ * Called by ~Scheduler, so detached Tasks never outlive their Scheduler.
+ * Detached Task waiting for event which never comes will block it forever.
+ * Caller OS thread sleeps on Futex, last destroyed detached Task wakes it.
+ */
+void Scheduler::wait_detached_tasks() noexcept
+{
+    while( detached_count() != 0 )
+    {
+        detached_futex_.wait();
+    }
+    // pass wake up to other waiters, Futex wake up is consumed by one of them
+    detached_futex_.notify_all();
+    // last Task may still be in release_detached(), it must not outlive this
+    while( detached_notifiers_.load( std::memory_order_acquire ) != 0 )
+    {
+        std::this_thread::yield();
+    }
+}
+/**
+ * @brief account destroyed (or migrated out) detached Task
+ *
+ * Wakes wait_detached_tasks() callers when last detached Task gone.
+ * Scheduler may be destroyed right after detached_count_ reaches 0,
+ * so ~Scheduler waits for detached_notifiers_ before freeing futex.
+ */
+void Scheduler::release_detached() noexcept
+{
+    detached_notifiers_.fetch_add( 1, std::memory_order_relaxed );
+    if( detached_count_.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    {
+        detached_futex_.notify_all();
+    }
+    detached_notifiers_.fetch_sub( 1, std::memory_order_release );
+}
+/**
+ * @brief get Scheduler of current OS thread
+ * @return Scheduler owning current BgThread or default Scheduler
+ */
+Scheduler& Scheduler::current()
+{
+    BgThread* thread = TaskRunner::current().bg_thread();
+    if( thread != nullptr )
+    {
+        return *thread->scheduler();
+    }
+    return instance();
+}
+/**
+ * @brief check current OS thread runs Task s of this Scheduler
+ *
+ * Does not create default Scheduler (unlike &current() == this).
+ * @return true if current thread is BgThread of this Scheduler or this is
+ * default Scheduler and current thread is not BgThread
+ */
+bool Scheduler::is_current() const noexcept
+{
+    BgThread* thread = TaskRunner::current().bg_thread();
+    if( thread != nullptr )
+    {
+        return thread->scheduler() == this;
+    }
+    return is_default_;
+}
+/**
+ * @brief get number of Task s of priority in running queues
+ *
+ * Only global running queues are counted, Normal priority Task s in
+ * BgThread local queues are not.
+ * With ALTERSTACK_FIFO_RUNNING_QUEUE all priorities share one FIFO and
+ * count of all Task s is returned.
+ * @param priority Task priority
+ * @return Task s count (approximate)
+ */
+size_t Scheduler::queue_depth( Task::Priority priority ) const noexcept
+{
+    size_t depth = 0;
+    for( uint32_t domain = 0; domain < domain_count_; ++domain )
+    {
+        depth += running_queues_[ domain ].depth( static_cast<uint32_t>( priority ) );
+    }
+    return depth;
+}
+/**
+ * @brief get StackAllocator for Task s of this Scheduler
+ * @return StackAllocator* (StackAllocator::default_allocator() for default Scheduler)
+ */
+StackAllocator* Scheduler::stack_allocator() const noexcept
+{
+    return stack_allocator_ != nullptr ? stack_allocator_ : StackAllocator::default_allocator();
+}
+/**
+ * @brief enable NUMA aware scheduling (one running queue and stack pool per NUMA node)
+ *
+ * MUST be called before Scheduler first used (before first Task created).
+ * Requires hwloc (ALTERSTACK_USE_HWLOC) to detect NUMA nodes, without it
+ * machine has single node and only StackAllocator changes.
+ * @param enable true to enable NUMA domains
+ */
+void Scheduler::set_numa_domains( bool enable ) noexcept
+{
+    numa_domains.store( enable, std::memory_order_release );
+}
+/**
+ * @brief check NUMA domains are enabled by set_numa_domains()
+ * @return true if enabled
+ */
+bool Scheduler::numa_domains_enabled() noexcept
+{
+    return numa_domains.load( std::memory_order_acquire );
+}
 /**
  * @brief schedule next task on current OS thread
  *
@@ -47,24 +235,33 @@ Scheduler::Scheduler()
  */
 bool Scheduler::schedule(TaskBase *current_task)
 {
-    return instance().do_schedule( current_task );
+    return current().do_schedule( current_task );
 }
 
 bool Scheduler::do_schedule( TaskBase *current_task )
 {
-    TaskBase* next_task = nullptr;
+    bool is_switched = false;
     while( true )
     {
-        next_task = get_next_task( current_task );
+        TaskBase* next_task = get_next_task( current_task );
         if( next_task != nullptr )
         {
-            break;
+            switch_to( next_task );
+            is_switched = true;
+            // AlterNative Task having nothing else to run switches back to Native
+            // even if it is still Waiting, Native MUST keep waiting then
+            if( !current_task->is_thread_bound()
+                    || current_task->m_state != TaskState::Waiting )
+            {
+                return true;
+            }
         }
         else
         {
             if( current_task->state({}) == TaskState::Running )
             {
-                return false;
+                consume_wakeup( current_task );
+                return is_switched;
             }
             else // Only bound Common current_task will get here
             {
@@ -77,8 +274,25 @@ bool Scheduler::do_schedule( TaskBase *current_task )
             }
         }
     }
-    switch_to( next_task );
-    return true;
+}
+/**
+ * @brief find next Task to run on current thread without switching to it
+ *
+ * Used by BgThread to look for Task while it is spinning, so it can stop
+ * spinning before running found Task.
+ * @return Task* or nullptr if nothing found
+ */
+TaskBase* Scheduler::find_next_task()
+{
+    return current().get_next_task( get_current_task() );
+}
+/**
+ * @brief switch current (bound) task to task found by find_next_task()
+ * @param task Task to run
+ */
+void Scheduler::run_task( TaskBase* task )
+{
+    switch_to( task );
 }
 /**
  * @brief switch OS thread to newly created Task, current task stay Running
@@ -86,13 +300,24 @@ bool Scheduler::do_schedule( TaskBase *current_task )
  */
 void Scheduler::run_new_task( TaskBase* task )
 {
-    instance().do_schedule_new_task(task);
+    current().do_schedule_new_task(task);
 }
 
 void Scheduler::do_schedule_new_task( TaskBase* task )
 {
     switch_to(task);
 }
+/**
+ * @brief put newly created Task in running queue, current task continue running
+ *
+ * New Task will be started by BgThread of it's Scheduler (or by any thread
+ * in schedule()), so creator does not pay for context switch.
+ * @param task new task to run
+ */
+void Scheduler::enqueue_new_task( Task* task ) noexcept
+{
+    enqueue_unbound_task( task );
+}
 /**
  * @brief switch current task to new and store old task in running if required
  * @param new_task next task to run
@@ -129,20 +354,97 @@ void Scheduler::switch_to( TaskBase* new_task )
 
     post_jump_fcontext( transfer, old_task );
 }
+/**
+ * @brief mark current Task parking before it is published in wait list
+ *
+ * Task becomes Waiting, m_context = nullptr protects it from being switched
+ * to before current thread switched it out, and (for AlterNative Task)
+ * m_is_parking makes thread switching it out enqueue it if it is released
+ * before switch is done. Locking is not needed: external thread changes
+ * state only from Waiting to Running at wake up, and Task is not in any
+ * wait list yet. After publishing Task MUST call schedule().
+ * @param task current Task
+ */
+void Scheduler::prepare_park( TaskBase* task ) noexcept
+{
+    task->m_state = TaskState::Waiting;
+    task->m_context = nullptr;
+    task->m_is_parking = !task->is_thread_bound();
+}
+/**
+ * @brief undo prepare_park() if Task was not published in wait list
+ * @param task current Task
+ */
+void Scheduler::cancel_park( TaskBase* task ) noexcept
+{
+    task->m_is_parking = false;
+    task->m_context = PARK_CANCELLED;
+    task->m_state = TaskState::Running;
+}
+/**
+ * @brief finish wait of Task released before it switched out and kept running
+ *
+ * Releaser makes parking Task Running and then marks it's m_context
+ * WAKEUP_PENDING (Task is not enqueued). If Task continues running without
+ * switch, that mark and m_is_parking MUST be consumed here, otherwise next
+ * switch out (or finish) of this Task would enqueue it as woken up.
+ * @param task current Task
+ */
+void Scheduler::consume_wakeup( TaskBase* task ) noexcept
+{
+    if( !task->m_is_parking )
+    {
+        return;
+    }
+    task->m_is_parking = false;
+    // releaser stores WAKEUP_PENDING right after making Task Running
+    while( task->m_context.load( std::memory_order_acquire ) != WAKEUP_PENDING )
+    {
+        cpu_relax();
+    }
+    task->m_context.store( nullptr, std::memory_order_relaxed );
+}
 /**
  * @brief store old task in running queue, if it is not nullptr and is AlterNative
+ *
+ * Finished detached Task is destroyed here, because it's Stack is not used anymore.
+ *
+ * Task switched out to wait (m_is_parking) can be released before it's context
+ * saved. In this case release() leaves WAKEUP_PENDING in m_context instead of
+ * waiting for context and Task is enqueued here (handoff), so exactly one
+ * of them enqueues woken up Task.
  * @param old_task task to store
  */
 void Scheduler::post_jump_fcontext( ::scontext::transfer_t transfer, TaskBase* current_task )
 {
     current_task->m_context = nullptr;
     TaskBase* prev_task = (TaskBase*)transfer.data;
-    prev_task->m_context = transfer.fctx;
+    const bool is_parking = prev_task->m_is_parking;
+    prev_task->m_is_parking = false;
+    assert( !is_parking || prev_task->m_state != TaskState::Finished );
+    Context old_context = prev_task->m_context.exchange( transfer.fctx, std::memory_order_acq_rel );
 
-    if( !prev_task->is_thread_bound()
-            && prev_task->m_state == TaskState::Running )
+    if( !prev_task->is_thread_bound() )
     {
-        enqueue_unbound_task( static_cast<Task*>(prev_task) );
+        Task* task = static_cast<Task*>(prev_task);
+        if( is_parking )
+        {
+            if( old_context == WAKEUP_PENDING )
+            {
+                enqueue_unbound_task( task );
+            }
+            return;
+        }
+        TaskState state = task->m_state;
+        if( state == TaskState::Running )
+        {
+            enqueue_yielded_task( task );
+        }
+        else if( state == TaskState::Finished
+                 && task->m_is_detached )
+        {
+            Task::destroy_embedded( task );
+        }
     }
 }
 /**
@@ -166,13 +468,46 @@ TaskBase* Scheduler::get_native_task()
     return TaskRunner::native_task();
 }
 /**
- * @brief get Task* from running queue
- * @return Task* or nullptr if queue is empty
+ * @brief get Task* from running queue of current NUMA domain, then from others
+ * @return Task* or nullptr if all queues are empty
  */
 TaskBase* Scheduler::get_running_from_queue() noexcept
+{
+    const uint32_t domain = ( domain_count_ == 1 )
+            ? 0 : CpuTopology::instance().current_numa_node() % domain_count_;
+    TaskBase* task = get_running_from_queue( domain );
+    if( task == nullptr )
+    {
+        task = get_running_from_other_domains( domain );
+    }
+    return task;
+}
+/**
+ * @brief get Task* from running queues of all NUMA domains except given one
+ * @param domain NUMA domain to skip
+ * @return Task* or nullptr if queues are empty
+ */
+TaskBase* Scheduler::get_running_from_other_domains( uint32_t domain ) noexcept
+{
+    for( uint32_t i = 1; i < domain_count_; ++i )
+    {
+        TaskBase* task = get_running_from_queue( ( domain + i ) % domain_count_ );
+        if( task != nullptr )
+        {
+            return task;
+        }
+    }
+    return nullptr;
+}
+/**
+ * @brief get Task* from running queue of NUMA domain
+ * @param domain NUMA domain
+ * @return Task* or nullptr if queue is empty
+ */
+TaskBase* Scheduler::get_running_from_queue( uint32_t domain ) noexcept
 {
     bool have_more_tasks = false;
-    TaskBase* task = running_queue_.get_item(have_more_tasks);
+    TaskBase* task = running_queues_[ domain ].get_item(have_more_tasks);
     if( task != nullptr
             && have_more_tasks)
     {
@@ -180,6 +515,96 @@ TaskBase* Scheduler::get_running_from_queue() noexcept
     }
     return task;
 }
+/**
+ * @brief get Task* of not Normal priority from running queue of NUMA domain
+ *
+ * Normal priority level is served by BgThread local queue, so weighted
+ * round robin turn of Normal level gives nullptr.
+ * @param domain NUMA domain
+ * @return Task* or nullptr
+ */
+TaskBase* Scheduler::get_not_normal_from_queue( uint32_t domain ) noexcept
+{
+    bool have_more_tasks = false;
+    TaskBase* task = running_queues_[ domain ].get_item_except(
+                static_cast<uint32_t>( Task::Priority::Normal ), have_more_tasks );
+    if( task != nullptr
+            && have_more_tasks)
+    {
+        bg_runner_.notify();
+    }
+    return task;
+}
+/**
+ * @brief get Task* from current thread run queues (local and global)
+ * @return Task* or nullptr if all queues are empty
+ */
+TaskBase* Scheduler::get_running_from_queues() noexcept
+{
+    BgThread* thread = TaskRunner::current().bg_thread();
+    if( thread == nullptr )
+    {
+        return get_running_from_queue();
+    }
+    return get_running_for_bg_thread( thread );
+}
+/**
+ * @brief get Task* for BgThread
+ *
+ * Order: not Normal priority Tasks of domain running queue, local queue
+ * (LIFO slot first), running queue of BgThread NUMA domain, steal from other
+ * BgThread of the same domain, then running queues and BgThread's of other
+ * domains. Local queue holds Normal priority Tasks only, so it takes turns
+ * of Normal level in weighted round robin of domain running queue and
+ * High, Low and Batch Tasks are not starved by local work. Every
+ * GLOBAL_QUEUE_CHECK_INTERVAL call domain running queue and local FIFO ring
+ * are checked first, so they can not be starved by Tasks waking each other
+ * through LIFO slot.
+ * @param thread current BgThread
+ * @return Task* or nullptr if nothing found
+ */
+TaskBase* Scheduler::get_running_for_bg_thread( BgThread* thread ) noexcept
+{
+    LocalRunQueue& local_queue = thread->local_queue();
+    const uint32_t domain = thread->numa_domain();
+    TaskBase* task = nullptr;
+    if( thread->next_schedule_tick() % GLOBAL_QUEUE_CHECK_INTERVAL == 0 )
+    {
+        task = get_running_from_queue( domain );
+        if( task == nullptr )
+        {
+            task = local_queue.steal(); // ring first, then LIFO slot
+        }
+    }
+    // relaxed depth loads only, no lock and no shared tick without such Tasks
+    if( task == nullptr
+            && running_queues_[ domain ].has_items_except( static_cast<uint32_t>( Task::Priority::Normal ) ) )
+    {
+        task = get_not_normal_from_queue( domain );
+    }
+    if( task == nullptr )
+    {
+        task = local_queue.pop();
+    }
+    if( task == nullptr )
+    {
+        task = get_running_from_queue( domain );
+    }
+    if( task == nullptr )
+    {
+        task = bg_runner_.steal( thread, false );
+    }
+    // own NUMA domain has nothing to run, help others
+    if( task == nullptr )
+    {
+        task = get_running_from_other_domains( domain );
+    }
+    if( task == nullptr )
+    {
+        task = bg_runner_.steal( thread, true );
+    }
+    return task;
+}
 /**
  * @brief get Native Task* if it is running or nullptr
  * @return Native Task* or nullptr
@@ -193,36 +618,95 @@ TaskBase* Scheduler::get_running_from_native()
     return nullptr;
 }
 /**
- * @brief enqueue task in running queue
+ * @brief enqueue new or woken up task in running queue
+ *
+ * On BgThread task goes to LIFO slot of local queue (it will run next on
+ * the same thread with hot cache), on other threads to running queue of
+ * current NUMA domain.
  * @param task task to store
  * get_next_from_native() is threadsafe
  */
 void Scheduler::enqueue_unbound_task( Task *task ) noexcept
 {
     assert(task != nullptr);
-    auto& scheduler = instance();
-    scheduler.running_queue_.put_item( task, static_cast<uint32_t>(task->priority()) );
+    auto& scheduler = *task->m_scheduler;
+    if( !scheduler.enqueue_local( task, true ) )
+    {
+        scheduler.current_running_queue().put_item( task, static_cast<uint32_t>(task->priority()) );
+    }
+    scheduler.bg_runner_.notify();
+}
+/**
+ * @brief enqueue task switched out while Running (yield) in running queue
+ *
+ * On BgThread task goes to the end of local FIFO ring, on other threads
+ * to running queue of current NUMA domain.
+ * @param task task to store
+ */
+void Scheduler::enqueue_yielded_task( Task *task ) noexcept
+{
+    assert(task != nullptr);
+    auto& scheduler = *task->m_scheduler;
+    if( !scheduler.enqueue_local( task, false ) )
+    {
+        scheduler.current_running_queue().put_item( task, static_cast<uint32_t>(task->priority()) );
+    }
     scheduler.bg_runner_.notify();
 }
 /**
- * @brief wait for Task::m_context becomes not null
+ * @brief enqueue task in current BgThread local queue
  *
- * m_context can be nullptr in case some Task makes waiting, another thread
- * release that waiting queue, but first thread still did not switch context
- * (so first task context still running on some thread). In this case Task
- * from waiting queue become running, but it MUST not be inserted in running queue
- * because some other thread can try to switch to it (even first thread can try
- * to switch to it's own context)
- * @param context Context*
+ * Only Task::Priority::Normal tasks use local queues, others keep
+ * global priority ordering.
+ * @param task task to store
+ * @param is_next store in LIFO slot (true) or in FIFO ring (false)
+ * @return false if task was not stored (not BgThread of this Scheduler,
+ * not Normal priority or local queue is full)
  */
-void Scheduler::wait_while_context_is_null( std::atomic<Context>* context ) noexcept
+bool Scheduler::enqueue_local( Task* task, bool is_next ) noexcept
 {
-    if( context->load( std::memory_order_acquire ) == nullptr )
+    if( task->priority() != Task::Priority::Normal )
+    {
+        return false;
+    }
+    BgThread* thread = TaskRunner::current().bg_thread();
+    if( thread == nullptr
+            || thread->scheduler() != this )
+    {
+        return false;
+    }
+    if( !is_next )
+    {
+        return thread->local_queue().push( task );
+    }
+    TaskBase* overflow = thread->local_queue().push_next( task );
+    if( overflow != nullptr )
     {
-        std::this_thread::sleep_for( std::chrono::microseconds(2) );
-        while( context->load( std::memory_order_acquire ) == nullptr )
-            std::this_thread::sleep_for( std::chrono::microseconds(10) );
+        running_queues_[ thread->numa_domain() ].put_item(
+                    overflow, static_cast<uint32_t>(Task::Priority::Normal) );
     }
+    return true;
+}
+/**
+ * @brief get running queue of current thread NUMA domain
+ *
+ * BgThread of this Scheduler uses it's domain, other threads domain of CPU
+ * they are running on.
+ * @return running queue reference
+ */
+RunningQueue& Scheduler::current_running_queue() noexcept
+{
+    if( domain_count_ == 1 )
+    {
+        return running_queues_[ 0 ];
+    }
+    BgThread* thread = TaskRunner::current().bg_thread();
+    if( thread != nullptr
+            && thread->scheduler() == this )
+    {
+        return running_queues_[ thread->numa_domain() ];
+    }
+    return running_queues_[ CpuTopology::instance().current_numa_node() % domain_count_ ];
 }
 /**
  * @brief get next Task* to run using schedule algorithm of Scheduler
@@ -233,7 +717,7 @@ TaskBase *Scheduler::get_next_task( TaskBase *current_task )
     TaskBase* next_task = nullptr;
     if( current_task->is_thread_bound() ) // Common or BgRunner thread in it's own context
     {
-        next_task = get_running_from_queue();
+        next_task = get_running_from_queues();
     }
     else // unbound Task in Common thread or in BgRunner
     {
@@ -246,12 +730,15 @@ TaskBase *Scheduler::get_next_task( TaskBase *current_task )
         }
         else // BgRunner in unbound context
         {
-            next_task = get_running_from_queue();
+            next_task = get_running_for_bg_thread( TaskRunner::current().bg_thread() );
         }
         auto current_state = current_task->state({});
+        // Task migrated to other Scheduler MUST leave this thread even if
+        // there is nothing else to run
         if( next_task == nullptr
                 && ( current_state == TaskState::Finished
-                     || current_state == TaskState::Waiting ) )
+                     || current_state == TaskState::Waiting
+                     || static_cast<Task*>( current_task )->m_scheduler != this ) )
         {
             next_task = get_native_task();
         }
@@ -263,11 +750,13 @@ TaskBase *Scheduler::get_next_task( TaskBase *current_task )
  * @brief make task (Native and AlterNative) running and schedule it to execution
  *
  * task must NOT be in any queue (because of multithreading)
+ *
+ * Never blocks: AlterNative Task still switching out (m_context == nullptr)
+ * is marked WAKEUP_PENDING and enqueued by thread switching it out.
  * @param task pointer to running Task
  */
 void Scheduler::add_waiting_list_to_running( TaskBase* task_list ) noexcept
 {
-    TaskBase* null_context_tasks = nullptr;
     while( task_list != nullptr )
     {
         TaskBase* task = task_list;
@@ -281,28 +770,18 @@ void Scheduler::add_waiting_list_to_running( TaskBase* task_list ) noexcept
         }
         else
         {
-            if( task->m_context.load( std::memory_order_acquire ) == nullptr )
-            { // if m_context == nullptr, Task still running.
-              // Will delay enqueueing it in Running queue untill m_context != nullptr
-                task->set_next( null_context_tasks );
-                null_context_tasks = task;
+            // if m_context == nullptr, Task still switching out, thread
+            // switching it will see WAKEUP_PENDING and enqueue it in post_jump_fcontext()
+            Context context = nullptr;
+            if( task->m_context.compare_exchange_strong( context, WAKEUP_PENDING
+                                                         ,std::memory_order_acq_rel
+                                                         ,std::memory_order_acquire ) )
+            {
                 continue;
             }
             enqueue_unbound_task( static_cast<Task*>(task) );
         }
     }
-    // Add delayed unbound Task's to running queue
-    while( null_context_tasks != nullptr )
-    {
-        TaskBase* task = null_context_tasks;
-        null_context_tasks = null_context_tasks->next();
-        task->set_next( nullptr );
-        while( task->m_context.load( std::memory_order_acquire ) == nullptr )
-        {
-            wait_while_context_is_null( &task->m_context );
-        }
-        enqueue_unbound_task( static_cast<Task*>(task) );
-    }
 }
 
 }
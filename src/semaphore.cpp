@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/semaphore.hpp"
+
+#include <cassert>
+#include <mutex>
+
+#include "alterstack/scheduler.hpp"
+#include "alterstack/task.hpp"
+
+namespace alterstack
+{
+
+Semaphore::~Semaphore()
+{
+    assert( m_data.load( std::memory_order_relaxed ).head == nullptr );
+    assert( m_fifo == nullptr );
+}
+/**
+ * @brief take one permit, park current Task until release() if there are none
+ */
+void Semaphore::acquire()
+{
+    if( try_acquire() )
+    {
+        return;
+    }
+    TaskBase* const current_task = Scheduler::get_current_task();
+    SemaphoreData data = m_data.load( std::memory_order_acquire );
+    Scheduler::prepare_park( current_task );
+    while( true )
+    {
+        SemaphoreData new_data = data;
+        if( data.count > 0 )
+        {
+            new_data.count = data.count - 1;
+            current_task->set_next( nullptr );
+            if( m_data.compare_exchange_weak( data, new_data
+                                              ,std::memory_order_acquire
+                                              ,std::memory_order_acquire ) )
+            {
+                Scheduler::cancel_park( current_task );
+                return;
+            }
+            continue;
+        }
+        current_task->set_next( data.head );
+        new_data.head = current_task;
+        if( m_data.compare_exchange_weak( data, new_data
+                                          ,std::memory_order_release
+                                          ,std::memory_order_acquire ) )
+        {
+            break;
+        }
+    }
+    // release() handed permit over to this Task and made it Running
+    Scheduler::schedule( current_task );
+}
+/**
+ * @brief take one permit if available
+ * @return true if permit taken
+ */
+bool Semaphore::try_acquire() noexcept
+{
+    SemaphoreData data = m_data.load( std::memory_order_relaxed );
+    while( data.count > 0 )
+    {
+        SemaphoreData new_data = data;
+        new_data.count = data.count - 1;
+        if( m_data.compare_exchange_weak( data, new_data
+                                          ,std::memory_order_acquire
+                                          ,std::memory_order_relaxed ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+/**
+ * @brief give permit to the oldest waiting Task or return it to Semaphore
+ *
+ * Without waiters permit is returned by single CAS, m_release_lock is taken
+ * only if there are waiters.
+ */
+void Semaphore::release() noexcept
+{
+    SemaphoreData data = m_data.load( std::memory_order_acquire );
+    while( data.head == nullptr
+           && data.is_fifo_used == 0 )
+    {
+        SemaphoreData new_data = data;
+        new_data.count = data.count + 1;
+        if( m_data.compare_exchange_weak( data, new_data
+                                          ,std::memory_order_acq_rel
+                                          ,std::memory_order_acquire ) )
+        {
+            return;
+        }
+    }
+    TaskBase* task = nullptr;
+    {
+        std::lock_guard<SpinLock> guard( m_release_lock );
+        if( m_fifo == nullptr )
+        {
+            m_fifo = take_waiters();
+        }
+        task = m_fifo;
+        if( task != nullptr )
+        {
+            m_fifo = task->next();
+            if( m_fifo == nullptr )
+            {
+                clear_fifo_used();
+            }
+        }
+    }
+    if( task != nullptr )
+    {
+        task->set_next( nullptr );
+        Scheduler::add_waiting_list_to_running( task );
+    }
+}
+/**
+ * @brief take all waiters from m_data or return permit if nobody waits
+ *
+ * m_release_lock MUST be locked and m_fifo empty (is_fifo_used is 0), so
+ * permit is returned only if there are no waiters at all.
+ * @return waiters list in acquire() order (oldest first) or nullptr
+ */
+TaskBase* Semaphore::take_waiters() noexcept
+{
+    SemaphoreData data = m_data.load( std::memory_order_acquire );
+    while( true )
+    {
+        SemaphoreData new_data = data;
+        if( data.head == nullptr )
+        {
+            new_data.count = data.count + 1;
+        }
+        else
+        {
+            new_data.head = nullptr;
+            new_data.is_fifo_used = 1;
+        }
+        if( m_data.compare_exchange_weak( data, new_data
+                                          ,std::memory_order_acq_rel
+                                          ,std::memory_order_acquire ) )
+        {
+            break;
+        }
+    }
+    // waiters stack is newest first, reverse it
+    TaskBase* fifo = nullptr;
+    TaskBase* task = data.head;
+    while( task != nullptr )
+    {
+        TaskBase* next = task->next();
+        task->set_next( fifo );
+        fifo = task;
+        task = next;
+    }
+    return fifo;
+}
+/**
+ * @brief mark m_fifo empty, lock free release() can return permits again
+ *
+ * m_release_lock MUST be locked.
+ */
+void Semaphore::clear_fifo_used() noexcept
+{
+    SemaphoreData data = m_data.load( std::memory_order_relaxed );
+    SemaphoreData new_data;
+    do
+    {
+        new_data = data;
+        new_data.is_fifo_used = 0;
+    } while( !m_data.compare_exchange_weak( data, new_data
+                                            ,std::memory_order_release
+                                            ,std::memory_order_relaxed ) );
+}
+
+}
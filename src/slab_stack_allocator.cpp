@@ -0,0 +1,303 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/slab_stack_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include <sys/mman.h>
+
+#include "alterstack/cpu_topology.hpp"
+
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102 // Linux 6.13+, older kernels return EINVAL
+#endif
+
+namespace alterstack
+{
+
+struct SlabStackAllocator::Slab
+{
+    void*  mapping;
+    size_t mapping_size;
+    Stack* stacks;
+    size_t count;
+    Slab*  next;
+};
+
+/**
+ * @brief create allocator, slabs are mapped on demand
+ * @param slab_size slab mapping size (at least one Stack per slab)
+ * @param pages slab memory pages type
+ */
+SlabStackAllocator::SlabStackAllocator( size_t slab_size, SlabPages pages )
+    :m_slab_size( slab_size )
+    ,m_pages( pages )
+{}
+/**
+ * @brief unmap all slabs, no Task may use Stack s from this allocator
+ */
+SlabStackAllocator::~SlabStackAllocator()
+{
+    while( m_slabs != nullptr )
+    {
+        Slab* slab = m_slabs;
+        m_slabs = slab->next;
+        for( size_t i = 0; i < slab->count; ++i )
+        {
+            slab->stacks[i].~Stack();
+        }
+        ::operator delete( slab->stacks );
+        auto result = ::munmap( slab->mapping, slab->mapping_size );
+        assert( result == 0 );
+        (void)result;
+        delete slab;
+    }
+}
+/**
+ * @brief get free Stack from slab (map new slab if no free Stack)
+ * @param size_class stack size class
+ * @param guard stack guard mode
+ * @return Stack* ready to use stack
+ */
+Stack* SlabStackAllocator::allocate( StackSize size_class, StackGuard guard )
+{
+    size_class = Stack::resolve( size_class );
+    const bool is_guarded = ( guard != StackGuard::None );
+    FreeList& free_list = m_free[ list_index( size_class, is_guarded ) ];
+    {
+        std::lock_guard<SpinLock> lock( free_list.lock );
+        if( free_list.head != nullptr )
+        {
+            Stack* stack = free_list.head;
+            free_list.head = stack->next();
+            stack->set_next( nullptr );
+            return stack;
+        }
+    }
+    Stack* stack_list = create_slab( size_class, is_guarded );
+    Stack* stack = stack_list;
+    stack_list = stack_list->next();
+    stack->set_next( nullptr );
+    if( stack_list != nullptr )
+    {
+        Stack* last = stack_list;
+        while( last->next() != nullptr )
+        {
+            last = last->next();
+        }
+        std::lock_guard<SpinLock> lock( free_list.lock );
+        last->set_next( free_list.head );
+        free_list.head = stack_list;
+    }
+    return stack;
+}
+/**
+ * @brief return Stack to free list
+ * @param stack Stack* to release
+ */
+void SlabStackAllocator::deallocate( Stack* stack ) noexcept
+{
+    if( m_pages == SlabPages::Normal
+            && m_release_memory.load( std::memory_order_relaxed ) )
+    {
+        stack->release_memory();
+    }
+    FreeList& free_list = m_free[ list_index( stack->size_class(), stack->guard() != StackGuard::None ) ];
+    std::lock_guard<SpinLock> lock( free_list.lock );
+    stack->set_next( free_list.head );
+    free_list.head = stack;
+}
+/**
+ * @brief map new slab and split it in Stack s
+ *
+ * Slab layout: [ guard | stack ][ guard | stack ]...
+ * @param size_class resolved stack size class
+ * @param is_guarded true to install guard pages below each Stack
+ * @return list of all slab Stack s in address order
+ */
+Stack* SlabStackAllocator::create_slab( StackSize size_class, bool is_guarded )
+{
+    const size_t guard_size = is_guarded ? Stack::default_guard_pages() * Stack::page_size() : 0;
+    const size_t slot_size  = guard_size + Stack::bytes( size_class );
+    size_t count = std::max<size_t>( 1, m_slab_size / slot_size );
+    if( !is_guarded && m_pages != SlabPages::Normal )
+    {   // huge pages slab size MUST be huge page size multiple
+        size_t huge_size = ( slot_size * count + HUGE_PAGE_SIZE - 1 ) & ~( HUGE_PAGE_SIZE - 1 );
+        count = huge_size / slot_size;
+    }
+    const size_t mapping_size = slot_size * count;
+
+    // allocate bookkeeping first, so failed allocation does not leak mapping
+    std::unique_ptr<Slab> slab{ new Slab{ nullptr, mapping_size, nullptr, count, nullptr } };
+    slab->stacks = static_cast<Stack*>( ::operator new( sizeof(Stack) * count ) );
+    void* mapping = nullptr;
+    try
+    {
+        mapping = map_slab( mapping_size, is_guarded );
+    }
+    catch( ... )
+    {
+        ::operator delete( slab->stacks );
+        throw;
+    }
+    slab->mapping = mapping;
+    const int32_t numa_node = m_numa_node.load( std::memory_order_relaxed );
+    if( numa_node >= 0 )
+    {   // before guards installed and Stack s painted, pages are not touched yet
+        CpuTopology::instance().bind_memory( mapping, mapping_size, static_cast<uint32_t>( numa_node ) );
+    }
+
+    const StackGuard guard = is_guarded ? StackGuard::Default : StackGuard::None;
+    char* slot = static_cast<char*>( mapping );
+    for( size_t i = 0; i < count; ++i, slot += slot_size )
+    {
+        if( guard_size != 0 )
+        {
+            install_guard( slot, guard_size );
+        }
+        Stack* stack = new( &slab->stacks[i] ) Stack( {}, slot + guard_size, guard_size, size_class, guard );
+        set_allocator( stack, this );
+        if( i != 0 )
+        {
+            slab->stacks[i-1].set_next( stack );
+        }
+    }
+    {
+        std::lock_guard<SpinLock> lock( m_slabs_lock );
+        slab->next = m_slabs;
+        m_slabs = slab.get();
+    }
+    m_slab_count.fetch_add( 1, std::memory_order_relaxed );
+    return &slab.release()->stacks[0];
+}
+/**
+ * @brief map slab memory using allocator pages type
+ *
+ * Huge pages mapping falls back to Normal pages if not available.
+ * @param size slab size
+ * @param is_guarded true if slab will have guard pages (always Normal pages)
+ * @return slab mapping, throws std::bad_alloc if failed
+ */
+void* SlabStackAllocator::map_slab( size_t size, bool is_guarded )
+{
+    void* mapping = nullptr;
+    if( !is_guarded && m_pages == SlabPages::HugeTLB )
+    {
+        mapping = map_huge_tlb( size );
+    }
+    if( !is_guarded && mapping == nullptr && m_pages != SlabPages::Normal )
+    {
+        mapping = map_transparent_huge( size );
+    }
+    if( mapping != nullptr )
+    {
+        m_huge_advised_slab_count.fetch_add( 1, std::memory_order_relaxed );
+        return mapping;
+    }
+    mapping = ::mmap( 0, size, PROT_READ | PROT_WRITE
+                      , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( mapping == MAP_FAILED ) throw std::bad_alloc();
+    return mapping;
+}
+/**
+ * @brief map slab from hugetlb pool
+ *
+ * Without MAP_NORESERVE, so mmap() fails if hugetlb pool is too small
+ * (instead of SIGBUS at page fault).
+ * @param size slab size, MUST be HUGE_PAGE_SIZE multiple
+ * @return mapping or nullptr if huge pages are not available
+ */
+void* SlabStackAllocator::map_huge_tlb( size_t size ) noexcept
+{
+    if( size % HUGE_PAGE_SIZE != 0 )
+    {
+        return nullptr;
+    }
+    void* mapping = ::mmap( 0, size, PROT_READ | PROT_WRITE
+                            , MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if ( mapping == MAP_FAILED )
+    {
+        return nullptr;
+    }
+    return mapping;
+}
+/**
+ * @brief map HUGE_PAGE_SIZE aligned slab and ask kernel to use transparent huge pages
+ * @param size slab size
+ * @return mapping or nullptr if THP is not available
+ */
+void* SlabStackAllocator::map_transparent_huge( size_t size ) noexcept
+{
+    // THP are used only for HUGE_PAGE_SIZE aligned ranges, so map more and trim
+    void* reserved = ::mmap( 0, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE
+                             , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( reserved == MAP_FAILED )
+    {
+        return nullptr;
+    }
+    uintptr_t begin   = reinterpret_cast<uintptr_t>( reserved );
+    uintptr_t aligned = ( begin + HUGE_PAGE_SIZE - 1 ) & ~( HUGE_PAGE_SIZE - 1 );
+    if( aligned != begin )
+    {
+        ::munmap( reserved, aligned - begin );
+    }
+    size_t tail = ( begin + size + HUGE_PAGE_SIZE ) - ( aligned + size );
+    if( tail != 0 )
+    {
+        ::munmap( reinterpret_cast<void*>( aligned + size ), tail );
+    }
+    void* mapping = reinterpret_cast<void*>( aligned );
+    if( ::madvise( mapping, size, MADV_HUGEPAGE ) != 0 )
+    {   // THP disabled in kernel, mapping is still usable with Normal pages
+        ::munmap( mapping, size );
+        return nullptr;
+    }
+    return mapping;
+}
+/**
+ * @brief make guard region inaccessible
+ *
+ * Uses madvise(MADV_GUARD_INSTALL) if kernel supports it (no VMA split),
+ * else mprotect(PROT_NONE)
+ * @param address guard region begin (page aligned)
+ * @param size guard region size
+ */
+void SlabStackAllocator::install_guard( void* address, size_t size ) noexcept
+{
+    static std::atomic<bool> guard_install_supported = { true };
+    if( guard_install_supported.load( std::memory_order_relaxed ) )
+    {
+        if( ::madvise( address, size, MADV_GUARD_INSTALL ) == 0 )
+        {
+            return;
+        }
+        guard_install_supported.store( false, std::memory_order_relaxed );
+    }
+    int result = ::mprotect( address, size, PROT_NONE );
+    assert( result == 0 );
+    (void)result;
+}
+
+}
@@ -23,26 +23,74 @@
 #include <valgrind/valgrind.h>
 #endif
 
+#include <algorithm>
 #include <stdexcept>
 #include <cassert>
 
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace alterstack
 {
+namespace
+{
+std::atomic<StackSize> default_stack_size  = { StackSize::Size1M };
+std::atomic<uint32_t>  default_guard_count = { 1 };
+std::atomic<StackProbe> stack_usage_probe  = { StackProbe::None };
+constexpr uint64_t PAINT_PATTERN = 0xA5A5A5A5A5A5A5A5ull;
+}
 /**
- * @brief allocates memory for stack, protect last page to prevent overflow
+ * @brief allocates memory for stack, protect guard pages below it to prevent overflow
+ *
+ * Guard pages are allocated in addition to size class bytes, so usable
+ * stack size is exactly Stack::bytes( size_class ).
+ * @param size_class stack size class
+ * @param guard StackGuard::Default - Stack::default_guard_pages() protected pages,
+ * StackGuard::None - no guard pages
  */
-Stack::Stack()
-    :m_size(1024*1024)
+Stack::Stack( StackSize size_class, StackGuard guard )
+    :m_size_class( resolve( size_class ) )
+    ,m_guard( guard )
+    ,m_owns_memory( true )
 {
-    m_base = ::mmap( 0, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if ( m_base == MAP_FAILED ) throw std::bad_alloc();
+    m_size = bytes( m_size_class );
+    m_guard_size = ( guard == StackGuard::None ) ? 0 : default_guard_pages() * page_size();
+    void* mapping = ::mmap( 0, m_guard_size + m_size, PROT_READ | PROT_WRITE
+                            , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( mapping == MAP_FAILED ) throw std::bad_alloc();
+    m_base = static_cast<char*>( mapping ) + m_guard_size;
 
-    int result = ::mprotect( m_base, 1, PROT_NONE);
-    assert( result == 0 );
+    if( m_guard_size != 0 )
+    {
+        int result = ::mprotect( mapping, m_guard_size, PROT_NONE);
+        assert( result == 0 );
+        (void)result;
+    }
+#if defined(WITH_VALGRIND)
+    m_valgrind_stack_id = VALGRIND_STACK_REGISTER( stack_top(), m_base );
+#endif
+}
+/**
+ * @brief create Stack in memory owned by SlabStackAllocator
+ * @param base usable stack memory begin (guard pages are already below it)
+ * @param guard_size guard pages size in bytes
+ * @param size_class resolved stack size class
+ * @param guard requested guard mode (slab free list key)
+ */
+Stack::Stack( Passkey<SlabStackAllocator>
+              ,void* base
+              ,size_t guard_size
+              ,StackSize size_class
+              ,StackGuard guard ) noexcept
+    :m_base( base )
+    ,m_size( bytes( size_class ) )
+    ,m_guard_size( guard_size )
+    ,m_size_class( size_class )
+    ,m_guard( guard )
+    ,m_owns_memory( false )
+{
 #if defined(WITH_VALGRIND)
-    m_valgrind_stack_id = VALGRIND_STACK_REGISTER( _stack_top(), m_stack_base);
+    m_valgrind_stack_id = VALGRIND_STACK_REGISTER( stack_top(), m_base );
 #endif
 }
 /**
@@ -53,8 +101,139 @@ Stack::~Stack()
 #if defined(WITH_VALGRIND)
     VALGRIND_STACK_DEREGISTER( m_valgrind_stack_id );
 #endif
-    auto result = ::munmap( m_base, m_size);
+    if( !m_owns_memory )
+    {
+        return;
+    }
+    auto result = ::munmap( static_cast<char*>( m_base ) - m_guard_size, m_guard_size + m_size );
     assert( result == 0 );
+    (void)result;
+}
+/**
+ * @brief give stack physical pages back to OS, stack stays usable (zero filled)
+ */
+void Stack::release_memory() noexcept
+{
+    ::madvise( m_base, m_size, MADV_DONTNEED );
+}
+/**
+ * @brief fill usable stack with pattern for StackProbe::Paint
+ *
+ * MUST be called before Stack is used by Task.
+ * @param keep_top bytes at stack top already holding data (not painted)
+ */
+void Stack::paint( size_t keep_top ) noexcept
+{
+    uint64_t* begin = static_cast<uint64_t*>( m_base );
+    std::fill( begin, begin + ( m_size - keep_top ) / sizeof(uint64_t), PAINT_PATTERN );
+}
+/**
+ * @brief measure max stack usage (high water mark)
+ *
+ * Can be called by Task running on this Stack.
+ * @param probe StackProbe::Paint (Stack must be painted before Task start)
+ * or StackProbe::Residency
+ * @return used bytes from stack top (0 for StackProbe::None)
+ */
+size_t Stack::used_bytes( StackProbe probe ) const noexcept
+{
+    const char* base = static_cast<const char*>( m_base );
+    if( probe == StackProbe::Paint )
+    {
+        const uint64_t* word = reinterpret_cast<const uint64_t*>( base );
+        const uint64_t* end  = reinterpret_cast<const uint64_t*>( base + m_size );
+        while( word != end && *word == PAINT_PATTERN )
+        {
+            ++word;
+        }
+        return base + m_size - reinterpret_cast<const char*>( word );
+    }
+    if( probe == StackProbe::Residency )
+    {
+        const size_t page = page_size();
+        unsigned char resident[ 1024*1024 / 4096 ];
+        size_t pages = std::min( m_size / page, sizeof(resident) );
+        if( ::mincore( const_cast<char*>( base + m_size - pages * page ), pages * page, resident ) != 0 )
+        {
+            return 0;
+        }
+        size_t i = 0;
+        while( i < pages && ( resident[i] & 1 ) == 0 )
+        {
+            ++i;
+        }
+        return ( pages - i ) * page;
+    }
+    return 0;
+}
+/**
+ * @brief get process wide default stack size class
+ * @return default size class (StackSize::Size1M if never set)
+ */
+StackSize Stack::default_size() noexcept
+{
+    return default_stack_size.load( std::memory_order_relaxed );
+}
+/**
+ * @brief set process wide default stack size class
+ *
+ * Should be called at startup, Task s created before keep their Stack size
+ * @param size_class new default size class (StackSize::Default is ignored)
+ */
+void Stack::set_default_size( StackSize size_class ) noexcept
+{
+    if( size_class == StackSize::Default )
+    {
+        return;
+    }
+    default_stack_size.store( size_class, std::memory_order_relaxed );
+}
+/**
+ * @brief get process wide guard pages count for StackGuard::Default Stack s
+ * @return guard pages count (1 if never set)
+ */
+uint32_t Stack::default_guard_pages() noexcept
+{
+    return default_guard_count.load( std::memory_order_relaxed );
+}
+/**
+ * @brief set process wide guard pages count for StackGuard::Default Stack s
+ *
+ * 0 disables guard pages for all Stack s.
+ * @param count guard pages count
+ */
+void Stack::set_default_guard_pages( uint32_t count ) noexcept
+{
+    default_guard_count.store( count, std::memory_order_relaxed );
+}
+/**
+ * @brief get process wide stack usage probe
+ * @return probe mode (StackProbe::None if never set)
+ */
+StackProbe Stack::usage_probe() noexcept
+{
+    return stack_usage_probe.load( std::memory_order_relaxed );
+}
+/**
+ * @brief set process wide stack usage probe
+ *
+ * Task s measure their Stack usage at finish and report it to StackUsageStats.
+ * Task s started before this call with StackProbe::Paint will report
+ * wrong values, so set it at startup.
+ * @param probe probe mode
+ */
+void Stack::set_usage_probe( StackProbe probe ) noexcept
+{
+    stack_usage_probe.store( probe, std::memory_order_relaxed );
+}
+/**
+ * @brief OS memory page size
+ * @return page size in bytes
+ */
+size_t Stack::page_size() noexcept
+{
+    static const size_t size = ::sysconf( _SC_PAGESIZE );
+    return size;
 }
 
 }
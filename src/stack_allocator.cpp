@@ -0,0 +1,56 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/stack_allocator.hpp"
+
+#include <atomic>
+
+#include "alterstack/stack_pool.hpp"
+
+namespace alterstack
+{
+namespace
+{
+std::atomic<StackAllocator*> default_stack_allocator = { nullptr };
+}
+/**
+ * @brief get process wide default StackAllocator
+ * @return StackAllocator* set by set_default_allocator() or StackPool::instance()
+ */
+StackAllocator* StackAllocator::default_allocator() noexcept
+{
+    StackAllocator* allocator = default_stack_allocator.load( std::memory_order_acquire );
+    if( allocator == nullptr )
+    {
+        return &StackPool::instance();
+    }
+    return allocator;
+}
+/**
+ * @brief set process wide default StackAllocator
+ *
+ * allocator MUST outlive all Task s using it
+ * @param allocator new default allocator (nullptr - StackPool::instance())
+ */
+void StackAllocator::set_default_allocator( StackAllocator* allocator ) noexcept
+{
+    default_stack_allocator.store( allocator, std::memory_order_release );
+}
+
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/stack_pool.hpp"
+
+#include <algorithm>
+
+namespace alterstack
+{
+
+struct StackPool::ThreadCache
+{
+    ThreadCache() = default;
+    ThreadCache( const ThreadCache& ) = delete;
+    ThreadCache& operator=( const ThreadCache& ) = delete;
+    ~ThreadCache();
+
+    Stack*   head  = nullptr;
+    uint32_t count = 0;
+};
+/**
+ * @brief move all thread cached Stack s to global list at thread exit
+ */
+StackPool::ThreadCache::~ThreadCache()
+{
+    StackPool::instance().flush_thread_cache( *this );
+}
+
+StackPool::StackPool() noexcept
+{
+    for( auto& count: m_global_count )
+    {
+        count.store( 0, std::memory_order_relaxed );
+    }
+}
+/**
+ * @brief get current thread Stack cache for list index
+ * @param index list index (see list_index())
+ * @return ThreadCache& thread local instance
+ */
+StackPool::ThreadCache& StackPool::thread_cache( uint32_t index )
+{
+    static thread_local ThreadCache cache[LIST_COUNT];
+    return cache[ index ];
+}
+/**
+ * @brief get cached Stack or allocate new one
+ *
+ * In steady state (released Stack count >= new Stack count) get() does not
+ * make any syscall.
+ * @param size_class stack size class
+ * @param guard stack guard mode
+ * @return Stack* ready to use stack
+ */
+Stack* StackPool::get( StackSize size_class, StackGuard guard )
+{
+    size_class = Stack::resolve( size_class );
+    const uint32_t index = list_index( size_class, guard != StackGuard::None );
+    ThreadCache& cache = thread_cache( index );
+    if( cache.head == nullptr )
+    {
+        get_from_global( cache, index );
+    }
+    if( cache.head != nullptr )
+    {
+        Stack* stack = cache.head;
+        cache.head = stack->next();
+        stack->set_next( nullptr );
+        --cache.count;
+        return stack;
+    }
+    Stack* stack = new Stack( size_class, guard );
+    set_allocator( stack, this );
+    return stack;
+}
+/**
+ * @brief return Stack to pool (or deallocate it if pool is full)
+ * @param stack Stack* to release, must not be used by any Task
+ */
+void StackPool::put( Stack* stack ) noexcept
+{
+    ThreadCache& cache = thread_cache( list_index( stack->size_class(), stack->guard() != StackGuard::None ) );
+    if( cache.count < m_thread_cache_size.load( std::memory_order_relaxed ) )
+    {
+        stack->set_next( cache.head );
+        cache.head = stack;
+        ++cache.count;
+        return;
+    }
+    put_to_global( stack );
+}
+/**
+ * @brief move global Stack list to thread cache
+ *
+ * Stack s over thread cache size will be returned to global list
+ * @param cache current thread cache (must be empty)
+ * @param index cache list index
+ */
+void StackPool::get_from_global( ThreadCache& cache, uint32_t index ) noexcept
+{
+    if( m_global_count[index].load( std::memory_order_relaxed ) == 0 )
+    {
+        return;
+    }
+    Stack* stack_list = m_global[index].pop_list();
+    Stack* cache_tail = nullptr;
+    uint32_t taken = 0;
+    // take at least one Stack for get() even if thread cache is disabled
+    const uint32_t cache_size = std::max<uint32_t>( 1, m_thread_cache_size.load( std::memory_order_relaxed ) );
+    while( stack_list != nullptr )
+    {
+        Stack* stack = stack_list;
+        stack_list = stack_list->next();
+        stack->set_next( nullptr );
+        if( cache.count < cache_size )
+        {   // keep list order, last released (hot) Stack s first
+            if( cache_tail == nullptr )
+            {
+                cache.head = stack;
+            }
+            else
+            {
+                cache_tail->set_next( stack );
+            }
+            cache_tail = stack;
+            ++cache.count;
+            ++taken;
+        }
+        else
+        {
+            m_global[index].push( stack );
+        }
+    }
+    m_global_count[index].fetch_sub( taken, std::memory_order_relaxed );
+}
+/**
+ * @brief store Stack in global list or deallocate it if list is full
+ *
+ * m_global_count incremented before push, so it is never less than
+ * real list size
+ * @param stack Stack* to store
+ */
+void StackPool::put_to_global( Stack* stack ) noexcept
+{
+    const uint32_t index = list_index( stack->size_class(), stack->guard() != StackGuard::None );
+    uint32_t count = m_global_count[index].fetch_add( 1, std::memory_order_relaxed );
+    if( count >= m_max_global.load( std::memory_order_relaxed ) )
+    {
+        m_global_count[index].fetch_sub( 1, std::memory_order_relaxed );
+        delete stack;
+        return;
+    }
+    if( m_release_memory.load( std::memory_order_relaxed ) )
+    {
+        stack->release_memory();
+    }
+    stack->set_next( nullptr );
+    m_global[index].push( stack );
+}
+/**
+ * @brief move all Stack s from thread cache to global list
+ * @param cache thread cache to flush
+ */
+void StackPool::flush_thread_cache( ThreadCache& cache ) noexcept
+{
+    while( cache.head != nullptr )
+    {
+        Stack* stack = cache.head;
+        cache.head = stack->next();
+        put_to_global( stack );
+    }
+    cache.count = 0;
+}
+
+}
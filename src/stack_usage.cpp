@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/stack_usage.hpp"
+
+namespace alterstack
+{
+
+StackUsageStats::StackUsageStats() noexcept
+{
+    reset();
+}
+/**
+ * @brief count one finished Task Stack usage
+ * @param size_class Task Stack size class
+ * @param used used bytes
+ */
+void StackUsageStats::add( StackSize size_class, size_t used ) noexcept
+{
+    ClassStats& stats = m_stats[ static_cast<uint32_t>( Stack::resolve( size_class ) ) ];
+    stats.count[ bucket( used ) ].fetch_add( 1, std::memory_order_relaxed );
+    size_t max_used = stats.max_used.load( std::memory_order_relaxed );
+    while( used > max_used
+           && !stats.max_used.compare_exchange_weak(
+               max_used, used, std::memory_order_relaxed ) )
+    {}
+}
+/**
+ * @brief get Stack usage histogram for size class
+ * @param size_class stack size class
+ * @return Histogram copy
+ */
+StackUsageStats::Histogram StackUsageStats::histogram( StackSize size_class ) const noexcept
+{
+    const ClassStats& stats = m_stats[ static_cast<uint32_t>( Stack::resolve( size_class ) ) ];
+    Histogram result;
+    result.samples = 0;
+    for( uint32_t i = 0; i < BUCKET_COUNT; ++i )
+    {
+        result.count[i] = stats.count[i].load( std::memory_order_relaxed );
+        result.samples += result.count[i];
+    }
+    result.max_used = stats.max_used.load( std::memory_order_relaxed );
+    return result;
+}
+/**
+ * @brief clear all histograms
+ */
+void StackUsageStats::reset() noexcept
+{
+    for( auto& stats: m_stats )
+    {
+        for( auto& count: stats.count )
+        {
+            count.store( 0, std::memory_order_relaxed );
+        }
+        stats.max_used.store( 0, std::memory_order_relaxed );
+    }
+}
+/**
+ * @brief find bucket for used bytes
+ * @param used used bytes
+ * @return bucket index (last bucket for anything over 512K)
+ */
+uint32_t StackUsageStats::bucket( size_t used ) noexcept
+{
+    uint32_t index = 0;
+    while( index < BUCKET_COUNT - 1
+           && used > bucket_limit( index ) )
+    {
+        ++index;
+    }
+    return index;
+}
+
+}
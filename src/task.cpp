@@ -26,6 +26,7 @@
 #include <iostream>
 
 #include "alterstack/scheduler.hpp"
+#include "alterstack/stack_usage.hpp"
 
 namespace alterstack
 {
@@ -40,20 +41,119 @@ TaskBase::~TaskBase()
 {}
 
 /**
- * @brief constructor to create thread unbound Task
- * @param runnable void() function or functor to start
+ * @brief get Scheduler new Task will run on
+ * @param options Task options
+ * @return options.scheduler or Scheduler::current()
  */
-Task::Task( ::std::function<void()> runnable )
-    :TaskBase{ false }
-    ,m_stack{ new Stack() }
-    ,m_runnable{ std::move(runnable) }
+Scheduler* Task::target_scheduler( const TaskOptions& options )
 {
-    m_context = ctx::make_fcontext( m_stack->stack_top(), m_stack->size(), _run_wrapper);
+    if( options.scheduler != nullptr )
+    {
+        return options.scheduler;
+    }
+    return &Scheduler::current();
+}
+/**
+ * @brief allocate Stack for new Task
+ * @param scheduler Scheduler new Task will run on
+ * @param options Task options (Stack size class, guard mode and allocator)
+ * @return Stack* from options.stack_allocator or Scheduler allocator
+ */
+Stack* Task::allocate_stack( Scheduler* scheduler, const TaskOptions& options )
+{
+    StackAllocator* allocator = options.stack_allocator;
+    if( allocator == nullptr )
+    {
+        allocator = scheduler->stack_allocator();
+    }
+    return allocator->allocate( options.stack_size, options.stack_guard );
+}
+/**
+ * @brief reserve memory at Stack top (before Task started)
+ *
+ * Context will be created below all reserved memory.
+ * @param stack Stack to reserve memory in
+ * @param reserved bytes already reserved at stack top, updated
+ * @param size bytes to reserve
+ * @param alignment required alignment
+ * @return pointer to reserved memory
+ */
+void* Task::reserve_stack_top( const Stack& stack, size_t& reserved
+                               ,size_t size, size_t alignment )
+{
+    if( reserved + size + alignment > stack.size() / 4 )
+    {
+        throw std::length_error( "Task runnable is too big for its Stack" );
+    }
+    uintptr_t top = reinterpret_cast<uintptr_t>( stack.stack_top() ) - reserved;
+    uintptr_t place = ( top - size ) & ~( uintptr_t( alignment ) - 1 );
+    reserved = reinterpret_cast<uintptr_t>( stack.stack_top() ) - place;
+    return reinterpret_cast<void*>( place );
+}
+/**
+ * @brief create context below reserved Stack top and switch to it (or enqueue it)
+ *
+ * Task of Scheduler not running on current thread is always enqueued, so it
+ * starts on BgThread of it's own Scheduler.
+ * @param launch TaskLaunch::Immediate - switch to new Task now,
+ * TaskLaunch::Enqueue - put new Task in running queue
+ */
+void Task::start( TaskLaunch launch )
+{
+    constexpr uintptr_t CONTEXT_ALIGNMENT = 16;
+    uintptr_t top = reinterpret_cast<uintptr_t>( m_stack->stack_top() ) - m_stack_reserved;
+    top &= ~( CONTEXT_ALIGNMENT - 1 );
+    size_t size = m_stack->size()
+            - ( reinterpret_cast<uintptr_t>( m_stack->stack_top() ) - top );
+    m_context = ctx::make_fcontext( reinterpret_cast<void*>( top ), size, _run_wrapper );
 
+    if( launch == TaskLaunch::Enqueue
+            || !m_scheduler->is_current() )
+    {
+        Scheduler::enqueue_new_task( this );
+        return;
+    }
     Scheduler::run_new_task( this );
 }
 
+/**
+ * @brief constructor to start Task embedded in its own Stack, used by Task::spawn()
+ * @param scheduler Scheduler to run Task on
+ * @param stack Stack holding this Task and runnable at its top
+ * @param reserved bytes at Stack top used by Task and runnable
+ * @param probe Stack usage measurement mode (Stack already painted if needed)
+ * @param runnable runnable object placed at Stack top
+ * @param invoke function to call and destroy runnable
+ * @param is_detached Task will be destroyed by Scheduler when finished
+ * @param launch switch to new Task or enqueue it
+ */
+Task::Task( Passkey<Task>, Scheduler* scheduler, Stack* stack, size_t reserved, StackProbe probe
+            ,void* runnable, InvokeFunction invoke, bool is_detached
+            ,TaskLaunch launch )
+    :TaskBase{ false }
+    ,m_scheduler{ scheduler }
+    ,m_stack{ stack }
+    ,m_usage_probe{ probe }
+    ,m_stack_reserved{ reserved }
+    ,m_runnable{ runnable }
+    ,m_invoke{ invoke }
+    ,m_is_detached{ is_detached }
+{
+    if( m_is_detached )
+    {
+        m_scheduler->detached_count_.fetch_add( 1, std::memory_order_relaxed );
+    }
+    start( launch );
+}
+
 Task::~Task()
+{
+    wait_finished();
+}
+/**
+ * @brief wait while Task finished and switched out from its Stack
+ */
+void Task::wait_finished()
 {
     release();
     while( m_state != TaskState::Finished
@@ -63,6 +163,32 @@ Task::~Task()
         ::std::this_thread::yield();
     }
 }
+/**
+ * @brief wait Task finished, destroy it and free Stack holding it
+ * @param task Task created by Task::spawn()
+ */
+void Task::Deleter::operator()( Task* task ) const noexcept
+{
+    task->wait_finished();
+    destroy_embedded( task );
+}
+/**
+ * @brief destroy finished Task placed at its Stack top and free that Stack
+ *
+ * Task MUST be finished and switched out from its Stack.
+ * @param task Task created by Task::create_embedded()
+ */
+void Task::destroy_embedded( Task* task ) noexcept
+{
+    Stack* stack = task->m_stack.release();
+    Scheduler* detached_scheduler = task->m_is_detached ? task->m_scheduler : nullptr;
+    task->~Task();
+    stack->allocator()->deallocate( stack );
+    if( detached_scheduler != nullptr )
+    {
+        detached_scheduler->release_detached();
+    }
+}
 /**
  * @brief constructor to create thread bound Task
  */
@@ -93,6 +219,35 @@ void Task::yield()
 {
     Scheduler::schedule() ;
 }
+/**
+ * @brief move current Task to other Scheduler
+ *
+ * Current Task is switched out and continues on BgThread of scheduler
+ * (so it returns on other OS thread). Does nothing if called from thread
+ * bound code (not from Task) or Task already runs on scheduler.
+ * @param scheduler Scheduler to run current Task on
+ */
+void Task::migrate( Scheduler& scheduler )
+{
+    TaskBase* current = Scheduler::get_current_task();
+    if( current->is_thread_bound() )
+    {
+        return;
+    }
+    Task* task = static_cast<Task*>( current );
+    if( task->m_scheduler == &scheduler )
+    {
+        return;
+    }
+    if( task->m_is_detached )
+    {
+        // detached Task is counted by the Scheduler that will destroy it
+        scheduler.detached_count_.fetch_add( 1, std::memory_order_relaxed );
+        task->m_scheduler->release_detached();
+    }
+    task->m_scheduler = &scheduler;
+    Scheduler::schedule( task );
+}
 
 /**
  * @brief switch caller Task in Waiting state while this is Running
@@ -107,6 +262,16 @@ void TaskBase::join()
     }
     m_awaitable.wait();
 }
+/**
+ * @brief measure Stack high water mark and add it to StackUsageStats
+ *
+ * Called by finishing Task on its own Stack
+ */
+void Task::report_stack_usage() noexcept
+{
+    StackUsageStats::instance().add( m_stack->size_class()
+                                     , m_stack->used_bytes( m_usage_probe ) );
+}
 /**
  * @brief helper function to start Task's runnable object and clean when it's finished
  * @param task_ptr pointer to Task instance
@@ -119,7 +284,11 @@ void Task::_run_wrapper( ::scontext::transfer_t transfer ) noexcept
         {
             Scheduler::post_jump_fcontext( {}, transfer, current );
 
-            current->m_runnable();
+            current->m_invoke( current->m_runnable );
+            if( current->m_usage_probe != StackProbe::None )
+            {
+                current->report_stack_usage();
+            }
             current->release();
             current->m_state.store( TaskState::Finished, std::memory_order_release );
         } // here all local objects NUST be destroyed because schedule() will never return
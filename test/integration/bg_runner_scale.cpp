@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+#include <dirent.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using alterstack::BgRunner;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+/**
+ * @brief count OS threads of current process
+ * @return threads count
+ */
+static int thread_count()
+{
+    int count = 0;
+    DIR* dir = ::opendir( "/proc/self/task" );
+    if( dir == nullptr )
+    {
+        return -1;
+    }
+    while( struct dirent* entry = ::readdir( dir ) )
+    {
+        if( entry->d_name[0] != '.' )
+        {
+            ++count;
+        }
+    }
+    ::closedir( dir );
+    return count;
+}
+
+static void busy_wait( std::chrono::microseconds duration )
+{
+    auto end = std::chrono::steady_clock::now() + duration;
+    while( std::chrono::steady_clock::now() < end )
+    {}
+}
+/**
+ * @brief check BgRunner starts BgThread's up to max_running under load
+ * and retires them after idle timeout
+ * @return 0 on success
+ */
+int main()
+{
+    constexpr int TASK_COUNT = 200;
+    BgRunner::set_thread_limits( 1, 4 );
+    BgRunner::set_idle_timeout( std::chrono::milliseconds( 50 ) );
+
+    std::atomic<int> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    Task::spawn_detached( [&finished]{ ++finished; }, options ); // create Scheduler
+    while( finished != 1 )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    int idle_threads = thread_count();
+
+    int max_threads = idle_threads;
+    for( int i = 0; i < TASK_COUNT; ++i )
+    {
+        Task::spawn_detached( [&finished]
+        {
+            busy_wait( std::chrono::microseconds( 500 ) );
+            ++finished;
+        }, options );
+    }
+    while( finished != TASK_COUNT + 1 )
+    {
+        max_threads = std::max( max_threads, thread_count() );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+    int retired_threads = thread_count();
+
+    std::cout << "threads idle " << idle_threads << " max " << max_threads
+              << " after idle timeout " << retired_threads << "\n";
+    if( max_threads <= idle_threads
+            || max_threads > idle_threads + 3
+            || retired_threads != idle_threads )
+    {
+        std::cerr << "FAILED: BgThread pool did not scale\n";
+        return EXIT_FAILURE;
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    return EXIT_SUCCESS;
+}
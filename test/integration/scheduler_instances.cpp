@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/scheduler.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using alterstack::Scheduler;
+using alterstack::Task;
+using alterstack::TaskHandle;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+/**
+ * @brief check Task s run on OS threads of their own Scheduler only and
+ * Task::migrate() moves Task to other Scheduler
+ * @return 0 on success
+ */
+int main()
+{
+    constexpr int TASK_COUNT = 100;
+    Scheduler latency( 1, 2 );
+    Scheduler batch( 1, 2 );
+
+    std::mutex mutex;
+    std::set<std::thread::id> latency_threads;
+    std::set<std::thread::id> batch_threads;
+    std::atomic<int> wrong_scheduler{ 0 };
+    {
+        std::vector<TaskHandle> tasks;
+        for( int i = 0; i < TASK_COUNT; ++i )
+        {
+            for( Scheduler* scheduler: { &latency, &batch } )
+            {
+                TaskOptions options;
+                options.scheduler = scheduler;
+                auto& threads = ( scheduler == &latency ) ? latency_threads : batch_threads;
+                tasks.push_back( Task::spawn( [&, scheduler]
+                {
+                    for( int y = 0; y < 3; ++y )
+                    {
+                        if( &Scheduler::current() != scheduler )
+                        {
+                            ++wrong_scheduler;
+                        }
+                        {
+                            std::lock_guard<std::mutex> lock( mutex );
+                            threads.insert( std::this_thread::get_id() );
+                        }
+                        Task::yield();
+                    }
+                }, options ) );
+            }
+        }
+    }
+    std::vector<std::thread::id> common;
+    for( auto id: latency_threads )
+    {
+        if( batch_threads.count( id ) != 0 )
+        {
+            common.push_back( id );
+        }
+    }
+    if( wrong_scheduler != 0
+            || !common.empty()
+            || latency_threads.count( std::this_thread::get_id() ) != 0 )
+    {
+        std::cerr << "FAILED: Task s ran on threads of other Scheduler\n";
+        return EXIT_FAILURE;
+    }
+
+    std::atomic<bool> migrated{ false };
+    {
+        TaskOptions options;
+        options.scheduler = &batch;
+        TaskHandle task = Task::spawn( [&]
+        {
+            const bool was_on_batch = ( &Scheduler::current() == &batch );
+            Task::migrate( latency );
+            migrated = was_on_batch && ( &Scheduler::current() == &latency );
+        }, options );
+    }
+    if( !migrated )
+    {
+        std::cerr << "FAILED: Task did not migrate to other Scheduler\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "latency threads " << latency_threads.size()
+              << " batch threads " << batch_threads.size() << "\n";
+    return EXIT_SUCCESS;
+}
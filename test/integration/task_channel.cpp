@@ -0,0 +1,187 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using alterstack::BgRunner;
+using alterstack::Channel;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+namespace
+{
+constexpr int WAIT_SECONDS = 60;
+
+template<typename Done>
+bool wait_for( Done done )
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( WAIT_SECONDS );
+    while( !done() )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            return false;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    // finished Tasks may still be switching out, wait them destroyed
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    return true;
+}
+/**
+ * @brief producer Tasks stream values to consumer Tasks until Channel closed
+ * @param capacity Channel capacity
+ * @param use_recv_many consumers receive by recv_many()
+ * @return true if every value received exactly once
+ */
+bool check_streaming( size_t capacity, bool use_recv_many )
+{
+    constexpr int PRODUCER_COUNT = 8;
+    constexpr int CONSUMER_COUNT = 8;
+    constexpr int VALUE_COUNT    = 2000; // per producer
+
+    Channel<std::unique_ptr<int>> channel( capacity );
+    std::atomic<long> received_sum{ 0 };
+    std::atomic<int>  received{ 0 };
+    std::atomic<int>  producing{ PRODUCER_COUNT };
+    std::atomic<int>  finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( int i = 0; i < CONSUMER_COUNT; ++i )
+    {
+        Task::spawn_detached( [&, use_recv_many]
+        {
+            std::vector<std::unique_ptr<int>> values;
+            std::unique_ptr<int> value;
+            while( true )
+            {
+                values.clear();
+                if( use_recv_many )
+                {
+                    if( channel.recv_many( values, 16 ) == 0 )
+                    {
+                        break;
+                    }
+                }
+                else
+                {
+                    if( !channel.recv( value ) )
+                    {
+                        break;
+                    }
+                    values.push_back( std::move( value ) );
+                }
+                for( auto& item: values )
+                {
+                    received_sum += *item;
+                    ++received;
+                }
+            }
+            ++finished;
+        }, options );
+    }
+    for( int i = 0; i < PRODUCER_COUNT; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            for( int n = 1; n <= VALUE_COUNT; ++n )
+            {
+                if( !channel.send( std::unique_ptr<int>( new int( n ) ) ) )
+                {
+                    std::cerr << "FAILED: send() to open Channel failed\n";
+                    std::exit( EXIT_FAILURE );
+                }
+            }
+            if( --producing == 0 )
+            {
+                channel.close();
+            }
+            ++finished;
+        }, options );
+    }
+    if( !wait_for( [&]{ return finished == PRODUCER_COUNT + CONSUMER_COUNT; } ) )
+    {
+        std::cerr << "FAILED: capacity " << capacity << " only " << finished << " of "
+                  << PRODUCER_COUNT + CONSUMER_COUNT << " Tasks finished\n";
+        return false;
+    }
+    const long expected_sum = long( PRODUCER_COUNT ) * VALUE_COUNT * ( VALUE_COUNT + 1 ) / 2;
+    if( received != PRODUCER_COUNT * VALUE_COUNT || received_sum != expected_sum )
+    {
+        std::cerr << "FAILED: capacity " << capacity << " received " << received
+                  << " values, sum " << received_sum << " expected " << expected_sum << "\n";
+        return false;
+    }
+    return true;
+}
+/**
+ * @brief try_send()/try_recv() never wait, closed Channel is drained and then fails
+ * @return true on success
+ */
+bool check_try_and_close()
+{
+    Channel<int> channel( 2 );
+    int value = 0;
+    if( channel.try_recv( value )
+            || !channel.try_send( 1 ) || !channel.try_send( 2 )
+            || channel.try_send( 3 ) || channel.size() != 2 )
+    {
+        std::cerr << "FAILED: try_send()/try_recv() on bounded Channel\n";
+        return false;
+    }
+    channel.close();
+    if( channel.send( 4 )
+            || !channel.recv( value ) || value != 1
+            || !channel.recv( value ) || value != 2
+            || channel.recv( value ) )
+    {
+        std::cerr << "FAILED: closed Channel is not drained in order\n";
+        return false;
+    }
+    return true;
+}
+}
+/**
+ * @brief check Channel streams values between Tasks for all capacities
+ * @return 0 on success
+ */
+int main()
+{
+    BgRunner::set_thread_limits( 4, 4 );
+    if( !check_try_and_close()
+            || !check_streaming( 0, false )
+            || !check_streaming( 4, false )
+            || !check_streaming( 4, true )
+            || !check_streaming( Channel<int>::UNBOUNDED, true ) )
+    {
+        return EXIT_FAILURE;
+    }
+    std::cout << "Channel OK\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using alterstack::BgRunner;
+using alterstack::Event;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+/**
+ * @brief check Event wakes up all waiters on set() and can be reused after reset()
+ * @return 0 on success
+ */
+int main()
+{
+    constexpr int WAITER_COUNT = 32;
+    constexpr int ROUND_COUNT  = 200;
+    BgRunner::set_thread_limits( 4, 4 );
+
+    Event start;
+    Event done;
+    std::atomic<int> round{ 0 };
+    std::atomic<int> arrived{ 0 };
+    std::atomic<int> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( int i = 0; i < WAITER_COUNT; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            for( int n = 1; n <= ROUND_COUNT; ++n )
+            {
+                start.wait();
+                while( round.load() < n )
+                {
+                    // start is still set from previous round, let main reset it
+                    Task::yield();
+                    start.wait();
+                }
+                if( ++arrived == WAITER_COUNT * n )
+                {
+                    done.set();
+                }
+            }
+            ++finished;
+        }, options );
+    }
+    // main (Native Task) drives rounds, reusing both Events
+    for( int n = 1; n <= ROUND_COUNT; ++n )
+    {
+        done.reset();
+        start.reset();
+        round = n;
+        start.set();
+        done.wait();
+        if( arrived != WAITER_COUNT * n )
+        {
+            std::cerr << "FAILED: round " << n << " " << arrived << " arrivals\n";
+            return EXIT_FAILURE;
+        }
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+    while( finished != WAITER_COUNT )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            std::cerr << "FAILED: only " << finished << " of " << WAITER_COUNT << " Tasks finished\n";
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    if( !start.is_set() || !done.is_set() )
+    {
+        std::cerr << "FAILED: Events not set after last round\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << ROUND_COUNT << " Event rounds done\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using alterstack::BgRunner;
+using alterstack::Future;
+using alterstack::Promise;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+namespace
+{
+/**
+ * @brief fan out sub-requests with async() and gather results, one of them throws
+ * @return true on success
+ */
+bool check_async()
+{
+    constexpr int REQUEST_COUNT = 64;
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+
+    std::vector<Future<std::unique_ptr<int>>> futures;
+    for( int i = 0; i < REQUEST_COUNT; ++i )
+    {
+        futures.push_back( alterstack::async( [i]
+        {
+            Task::yield();
+            if( i == REQUEST_COUNT / 2 )
+            {
+                throw std::runtime_error( "sub-request failed" );
+            }
+            return std::unique_ptr<int>( new int( i ) );
+        }, options ) );
+    }
+    long sum = 0;
+    int failed = 0;
+    for( auto& future: futures )
+    {
+        try
+        {
+            sum += *future.get();
+        }
+        catch( const std::runtime_error& )
+        {
+            ++failed;
+        }
+        if( future.valid() )
+        {
+            std::cerr << "FAILED: Future is valid after get()\n";
+            return false;
+        }
+    }
+    const long expected = long( REQUEST_COUNT ) * ( REQUEST_COUNT - 1 ) / 2 - REQUEST_COUNT / 2;
+    if( failed != 1 || sum != expected )
+    {
+        std::cerr << "FAILED: sum " << sum << " expected " << expected
+                  << ", " << failed << " exceptions\n";
+        return false;
+    }
+    // void result, waited from inside other Task
+    Future<int> outer = alterstack::async( []
+    {
+        int count = 0;
+        Future<void> inner = alterstack::async( [&count]{ ++count; } );
+        inner.get();
+        return count;
+    }, options );
+    if( outer.get() != 1 )
+    {
+        std::cerr << "FAILED: Future<void> not waited\n";
+        return false;
+    }
+    return true;
+}
+/**
+ * @brief Promise set from other Task, broken Promise reported to Future
+ * @return true on success
+ */
+bool check_promise()
+{
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+
+    auto promise = std::make_shared<Promise<std::string>>();
+    Future<std::string> future = promise->get_future();
+    Task::spawn_detached( [promise]
+    {
+        Task::yield();
+        promise->set_value( "value" );
+    }, options );
+    if( future.get() != "value" )
+    {
+        std::cerr << "FAILED: Promise value not received\n";
+        return false;
+    }
+    Future<int> broken;
+    {
+        Promise<int> promise_int;
+        broken = promise_int.get_future();
+    }
+    try
+    {
+        broken.get();
+        std::cerr << "FAILED: broken Promise not reported\n";
+        return false;
+    }
+    catch( const std::future_error& error )
+    {
+        if( error.code() != std::future_errc::broken_promise )
+        {
+            std::cerr << "FAILED: unexpected error " << error.what() << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+/**
+ * @brief State counting its live instances for check_throwing_runnable()
+ */
+struct CountedState
+{
+    CountedState()
+    {
+        ++live_count;
+    }
+    ~CountedState()
+    {
+        --live_count;
+    }
+    static int live_count;
+};
+int CountedState::live_count = 0;
+/**
+ * @brief runnable throwing from move constructor
+ */
+struct ThrowingMove
+{
+    ThrowingMove() = default;
+    ThrowingMove( ThrowingMove&& )
+    {
+        throw std::runtime_error( "runnable move failed" );
+    }
+    void operator()( CountedState& )
+    {}
+};
+/**
+ * @brief State placed at Stack top is destroyed if runnable constructor throws
+ * @return true on success
+ */
+bool check_throwing_runnable()
+{
+    CountedState* state = nullptr;
+    try
+    {
+        Task::spawn_with_state( ThrowingMove{}, state );
+        std::cerr << "FAILED: runnable exception not propagated\n";
+        return false;
+    }
+    catch( const std::runtime_error& )
+    {}
+    if( CountedState::live_count != 0 || state != nullptr )
+    {
+        std::cerr << "FAILED: State not destroyed after runnable exception\n";
+        return false;
+    }
+    return true;
+}
+}
+/**
+ * @brief check Future gets values and exceptions from async() Tasks and Promise
+ * @return 0 on success
+ */
+int main()
+{
+    BgRunner::set_thread_limits( 4, 4 );
+    if( !check_async() || !check_promise() || !check_throwing_runnable() )
+    {
+        return EXIT_FAILURE;
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    std::cout << "Future OK\n";
+    return EXIT_SUCCESS;
+}
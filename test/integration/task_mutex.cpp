@@ -0,0 +1,163 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using alterstack::BgRunner;
+using alterstack::Mutex;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+/**
+ * @brief check waiters get Mutex in lock() order
+ *
+ * Immediate Task runs on main thread until it parks in lock(), so Tasks
+ * park in creation order.
+ * @return true on success
+ */
+bool check_fifo()
+{
+    constexpr int TASK_COUNT = 16;
+    Mutex mutex;
+    std::vector<int> order;
+    std::atomic<int> finished{ 0 };
+    mutex.lock();
+    for( int i = 0; i < TASK_COUNT; ++i )
+    {
+        Task::spawn_detached( [&mutex, &order, &finished, i]
+        {
+            std::lock_guard<Mutex> guard( mutex );
+            order.push_back( i );
+            ++finished;
+        } );
+    }
+    mutex.unlock();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+    while( finished != TASK_COUNT )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            std::cerr << "FAILED: only " << finished << " of " << TASK_COUNT << " FIFO Tasks finished\n";
+            return false;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    std::lock_guard<Mutex> guard( mutex );
+    for( int i = 0; i < TASK_COUNT; ++i )
+    {
+        if( order[i] != i )
+        {
+            std::cerr << "FAILED: Task " << order[i] << " got Mutex " << i << "th\n";
+            return false;
+        }
+    }
+    return true;
+}
+/**
+ * @brief check Mutex gives mutual exclusion to AlterNative Tasks switching
+ * inside critical section and to Native (main thread) Task
+ * @return 0 on success
+ */
+int main()
+{
+    constexpr int TASK_COUNT      = 64;
+    constexpr int LOCK_COUNT      = 500;
+    constexpr int MAIN_LOCK_COUNT = 2000;
+    BgRunner::set_thread_limits( 4, 4 );
+    if( !check_fifo() )
+    {
+        return EXIT_FAILURE;
+    }
+
+    Mutex mutex;
+    long counter = 0;
+    std::atomic<int> inside{ 0 };
+    std::atomic<bool> overlapped{ false };
+    std::atomic<int> finished{ 0 };
+    auto critical_section = [&]( bool do_yield )
+    {
+        std::lock_guard<Mutex> guard( mutex );
+        if( ++inside != 1 )
+        {
+            overlapped = true;
+        }
+        const long value = counter;
+        if( do_yield )
+        {
+            Task::yield();
+        }
+        counter = value + 1;
+        --inside;
+    };
+
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( int i = 0; i < TASK_COUNT; ++i )
+    {
+        Task::spawn_detached( [&critical_section, &finished, i]
+        {
+            for( int n = 0; n < LOCK_COUNT; ++n )
+            {
+                critical_section( ( n + i ) % 4 == 0 );
+            }
+            ++finished;
+        }, options );
+    }
+    for( int n = 0; n < MAIN_LOCK_COUNT; ++n )
+    {
+        critical_section( false );
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+    while( finished != TASK_COUNT )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            std::cerr << "FAILED: only " << finished << " of " << TASK_COUNT << " Tasks finished\n";
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    const long expected = TASK_COUNT * LOCK_COUNT + MAIN_LOCK_COUNT;
+    std::lock_guard<Mutex> guard( mutex );
+    if( overlapped || counter != expected )
+    {
+        std::cerr << "FAILED: counter " << counter << " expected " << expected << "\n";
+        return EXIT_FAILURE;
+    }
+    if( !mutex.try_lock() )
+    {
+        std::cout << counter << " locks done\n";
+        return EXIT_SUCCESS;
+    }
+    std::cerr << "FAILED: try_lock() locked owned Mutex\n";
+    mutex.unlock();
+    return EXIT_FAILURE;
+}
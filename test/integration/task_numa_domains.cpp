@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+#include "alterstack/cpu_topology.hpp"
+#include "alterstack/numa_stack_allocator.hpp"
+#include "alterstack/scheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using alterstack::BgRunner;
+using alterstack::CpuTopology;
+using alterstack::NumaStackAllocator;
+using alterstack::Scheduler;
+using alterstack::Stack;
+using alterstack::StackAllocator;
+using alterstack::StackGuard;
+using alterstack::StackSize;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+/**
+ * @brief check Tasks run (and migrate between NUMA domains when yielding)
+ * with Scheduler NUMA domains enabled and Stack s come from node local pool
+ * @return 0 on success
+ */
+int main()
+{
+    constexpr int TASK_COUNT  = 1000;
+    constexpr int YIELD_COUNT = 10;
+    Scheduler::set_numa_domains( true );
+    BgRunner::set_thread_limits( 4, 4 ); // BgThread's in each domain
+    std::cout << "NUMA nodes " << CpuTopology::instance().numa_node_count() << "\n";
+
+    std::atomic<int> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    Task::spawn_detached( [&finished]{ ++finished; }, options ); // create Scheduler
+    while( finished != 1 )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    auto allocator = dynamic_cast<NumaStackAllocator*>( StackAllocator::default_allocator() );
+    if( allocator == nullptr
+            || allocator->node_count() != CpuTopology::instance().numa_node_count() )
+    {
+        std::cerr << "FAILED: NumaStackAllocator is not default StackAllocator\n";
+        return EXIT_FAILURE;
+    }
+    Stack* stack = allocator->allocate( StackSize::Default, StackGuard::None );
+    const uint32_t node = CpuTopology::instance().current_numa_node();
+    if( stack->allocator() != &allocator->node_allocator( node ) )
+    {
+        std::cerr << "FAILED: Stack is not allocated from current node pool\n";
+        return EXIT_FAILURE;
+    }
+    allocator->deallocate( stack );
+
+    for( int i = 0; i < TASK_COUNT; ++i )
+    {
+        Task::spawn_detached( [&finished]
+        {
+            for( int y = 0; y < YIELD_COUNT; ++y )
+            {
+                Task::yield();
+            }
+            ++finished;
+        }, options );
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 30 );
+    while( finished != TASK_COUNT + 1 )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            std::cerr << "FAILED: only " << finished << " Tasks finished\n";
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    std::cout << TASK_COUNT << " Tasks finished\n";
+    return EXIT_SUCCESS;
+}
@@ -23,6 +23,8 @@
 #include <iostream>
 
 using alterstack::Task;
+using alterstack::TaskOptions;
+using alterstack::StackSize;
 
 void ctx_function()
 {
@@ -56,6 +58,7 @@ int main()
     con_task10.join();
     Task con_task11{ ::std::bind(ctx_arg1, 0) };
     Task con_task12{ ::std::bind(ctx_arg1, 11) };
+    Task small_task{ ctx_function2, TaskOptions{ StackSize::Size16K } };
 
     Task::yield();
     std::cout << "Returned to main\n";
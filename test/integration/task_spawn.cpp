@@ -0,0 +1,163 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using alterstack::Task;
+using alterstack::TaskHandle;
+using alterstack::TaskOptions;
+using alterstack::TaskLaunch;
+using alterstack::StackSize;
+using alterstack::StackProbe;
+using alterstack::Stack;
+
+static int check( bool condition, const char* message )
+{
+    if( !condition )
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        return 1;
+    }
+    return 0;
+}
+/**
+ * @brief start Tasks embedded in their own Stack (owned and detached)
+ * and check they run and finish
+ * @return 0 on success
+ */
+int main()
+{
+    int failed = 0;
+    std::atomic<int> counter{ 0 };
+    {
+        TaskHandle task = Task::spawn( [&counter]{ ++counter; } );
+        task->join();
+        failed += check( counter == 1, "spawned Task did not run" );
+    }
+    {
+        std::vector<TaskHandle> tasks;
+        for( int i = 0; i < 100; ++i )
+        {
+            tasks.push_back( Task::spawn( [&counter]
+            {
+                Task::yield();
+                ++counter;
+            }, TaskOptions{ StackSize::Size16K } ) );
+        }
+        for( auto& task : tasks )
+        {
+            task->join();
+        }
+        failed += check( counter == 101, "not all spawned Tasks finished" );
+    }
+    {
+        // Task control block must be placed at the top of its own Stack
+        uintptr_t task_address = 0;
+        uintptr_t local_address = 0;
+        TaskHandle task = Task::spawn( [&local_address]
+        {
+            int local = 0;
+            local_address = reinterpret_cast<uintptr_t>( &local );
+        } );
+        task->join();
+        task_address = reinterpret_cast<uintptr_t>( task.get() );
+        failed += check( task_address > local_address
+                         && task_address - local_address < 4096
+                         , "Task is not placed at its Stack top" );
+    }
+    {
+        // painting must not overwrite Task placed at Stack top
+        Stack::set_usage_probe( StackProbe::Paint );
+        int value = 0;
+        TaskHandle task = Task::spawn( [&value]{ value = 42; } );
+        task->join();
+        Stack::set_usage_probe( StackProbe::None );
+        failed += check( value == 42, "spawned Task with painted Stack did not run" );
+    }
+    {
+        // detached Tasks are destroyed by Scheduler, nobody joins them
+        std::atomic<int> finished{ 0 };
+        for( int i = 0; i < 1000; ++i )
+        {
+            Task::spawn_detached( [&finished, i]
+            {
+                if( i % 2 == 0 )
+                {
+                    Task::yield();
+                }
+                ++finished;
+            }, TaskOptions{ StackSize::Size16K } );
+        }
+        while( finished != 1000 )
+        {
+            Task::yield();
+            std::this_thread::yield();
+        }
+        failed += check( finished == 1000, "not all detached Tasks finished" );
+        alterstack::Scheduler::instance().wait_detached_tasks();
+        failed += check( alterstack::Scheduler::instance().detached_count() == 0
+                         ,"detached Tasks not destroyed" );
+    }
+    {
+        // enqueued Task does not run in creator context until creator yields
+        std::atomic<int> finished{ 0 };
+        TaskOptions options;
+        options.launch = TaskLaunch::Enqueue;
+        std::vector<TaskHandle> tasks;
+        for( int i = 0; i < 100; ++i )
+        {
+            tasks.push_back( Task::spawn( [&finished]{ ++finished; }, options ) );
+        }
+        Task enqueued{ [&finished]{ ++finished; }, options };
+        for( auto& task : tasks )
+        {
+            task->join();
+        }
+        enqueued.join();
+        failed += check( finished == 101, "not all enqueued Tasks finished" );
+    }
+    {
+        bool thrown = false;
+        try
+        {
+            struct { char data[8192]; } big{};
+            TaskHandle task = Task::spawn( [big]{ (void)big; }, TaskOptions{ StackSize::Size16K } );
+        }
+        catch( const std::length_error& )
+        {
+            thrown = true;
+        }
+        failed += check( thrown, "too big runnable accepted" );
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    if( failed != 0 )
+    {
+        return EXIT_FAILURE;
+    }
+    std::cout << "task_spawn passed\n";
+    return EXIT_SUCCESS;
+}
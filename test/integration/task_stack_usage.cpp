@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/stack_usage.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+using alterstack::Stack;
+using alterstack::StackProbe;
+using alterstack::StackSize;
+using alterstack::StackUsageStats;
+using alterstack::Task;
+using alterstack::TaskOptions;
+
+/**
+ * @brief touch about bytes of stack
+ *
+ * Recursion with small frames keeps usage proportional to bytes with any
+ * optimization level (big buffer is always in frame at -O0).
+ * @param bytes stack bytes to use
+ */
+void use_stack( size_t bytes )
+{
+    volatile char buffer[ 1024 ];
+    if( bytes == 0 )
+    {
+        return;
+    }
+    for( size_t i = 0; i < sizeof(buffer); i += 64 )
+    {
+        buffer[ sizeof(buffer) - 1 - i ] = 1; // stack grows down
+    }
+    use_stack( bytes > sizeof(buffer) ? bytes - sizeof(buffer) : 0 );
+    buffer[0] = 0; // no tail call, frame must stay alive during recursion
+}
+
+bool check( StackProbe probe, TaskOptions options )
+{
+    StackUsageStats& stats = StackUsageStats::instance();
+    stats.reset();
+    Stack::set_usage_probe( probe );
+    {
+        Task small{ []{ use_stack( 0 ); }, options };
+        Task big{ []{ use_stack( 40*1024 ); }, options };
+    }
+    Stack::set_usage_probe( StackProbe::None );
+    auto histogram = stats.histogram( options.stack_size );
+    std::cout << "samples " << histogram.samples << " max_used " << histogram.max_used << "\n";
+    for( uint32_t i = 0; i < StackUsageStats::BUCKET_COUNT; ++i )
+    {
+        std::cout << "  up to " << StackUsageStats::bucket_limit( i ) / 1024 << "K: "
+                  << histogram.count[i] << "\n";
+    }
+    return histogram.samples == 2
+            && histogram.max_used > 32*1024
+            && histogram.max_used < 64*1024;
+}
+
+int main()
+{
+    TaskOptions options;
+    options.stack_size = StackSize::Size256K;
+    // first Task s get fresh mmap()'ed Stack s, required for StackProbe::Residency
+    if( !check( StackProbe::Residency, options ) )
+    {
+        std::cerr << "StackProbe::Residency failed\n";
+        return EXIT_FAILURE;
+    }
+    if( !check( StackProbe::Paint, options ) )
+    {
+        std::cerr << "StackProbe::Paint failed\n";
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+#include "alterstack/stack_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using alterstack::BgRunner;
+using alterstack::ConditionVariable;
+using alterstack::Mutex;
+using alterstack::Semaphore;
+using alterstack::StackPool;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+namespace
+{
+constexpr int WAIT_SECONDS = 60;
+
+template<typename Done>
+bool wait_for( Done done )
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( WAIT_SECONDS );
+    while( !done() )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            return false;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    // finished Tasks may still be switching out, wait them destroyed
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    return true;
+}
+/**
+ * @brief Tasks switching while holding Semaphore permit never exceed permits count
+ * @return true on success
+ */
+bool check_semaphore()
+{
+    constexpr int PERMIT_COUNT  = 3;
+    constexpr int TASK_COUNT    = 64;
+    constexpr int ACQUIRE_COUNT = 200;
+
+    Semaphore semaphore( PERMIT_COUNT );
+    std::atomic<int> inside{ 0 };
+    std::atomic<int> max_inside{ 0 };
+    std::atomic<int> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( int i = 0; i < TASK_COUNT; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            for( int n = 0; n < ACQUIRE_COUNT; ++n )
+            {
+                semaphore.acquire();
+                const int now_inside = ++inside;
+                int max = max_inside.load();
+                while( now_inside > max
+                       && !max_inside.compare_exchange_weak( max, now_inside ) )
+                {}
+                Task::yield();
+                --inside;
+                semaphore.release();
+            }
+            ++finished;
+        }, options );
+    }
+    // Native Task competes for permits too
+    for( int n = 0; n < ACQUIRE_COUNT; ++n )
+    {
+        semaphore.acquire();
+        semaphore.release();
+    }
+    if( !wait_for( [&]{ return finished == TASK_COUNT; } ) )
+    {
+        std::cerr << "FAILED: only " << finished << " of " << TASK_COUNT << " Tasks finished\n";
+        return false;
+    }
+    if( max_inside > PERMIT_COUNT || semaphore.count() != PERMIT_COUNT )
+    {
+        std::cerr << "FAILED: " << max_inside << " Tasks holding " << PERMIT_COUNT
+                  << " permits, " << semaphore.count() << " permits left\n";
+        return false;
+    }
+    return true;
+}
+/**
+ * @brief every item produced by Tasks is consumed by Tasks waiting on ConditionVariable
+ * @return true on success
+ */
+bool check_condition_variable()
+{
+    constexpr int CONSUMER_COUNT = 16;
+    constexpr int PRODUCER_COUNT = 16;
+    constexpr int ITEM_COUNT     = 500; // per producer
+
+    Mutex mutex;
+    ConditionVariable cond_var;
+    std::deque<int> items;
+    bool producers_done = false;
+    long consumed_sum = 0;
+    int  consumed = 0;
+    std::atomic<int> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( int i = 0; i < CONSUMER_COUNT; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            std::unique_lock<Mutex> lock( mutex );
+            while( true )
+            {
+                cond_var.wait( lock, [&]{ return !items.empty() || producers_done; } );
+                if( items.empty() )
+                {
+                    break;
+                }
+                consumed_sum += items.front();
+                ++consumed;
+                items.pop_front();
+            }
+            ++finished;
+        }, options );
+    }
+    std::atomic<int> producing{ PRODUCER_COUNT };
+    for( int i = 0; i < PRODUCER_COUNT; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            for( int n = 1; n <= ITEM_COUNT; ++n )
+            {
+                {
+                    std::lock_guard<Mutex> guard( mutex );
+                    items.push_back( n );
+                }
+                cond_var.notify_one();
+                if( n % 16 == 0 )
+                {
+                    Task::yield();
+                }
+            }
+            if( --producing == 0 )
+            {
+                {
+                    std::lock_guard<Mutex> guard( mutex );
+                    producers_done = true;
+                }
+                cond_var.notify_all();
+            }
+            ++finished;
+        }, options );
+    }
+    // producers notify outside of Mutex, wait them too before destroying ConditionVariable
+    if( !wait_for( [&]{ return finished == CONSUMER_COUNT + PRODUCER_COUNT; } ) )
+    {
+        std::cerr << "FAILED: only " << finished << " of " << CONSUMER_COUNT + PRODUCER_COUNT
+                  << " Tasks finished\n";
+        return false;
+    }
+    const long expected_sum = long( PRODUCER_COUNT ) * ITEM_COUNT * ( ITEM_COUNT + 1 ) / 2;
+    std::lock_guard<Mutex> guard( mutex );
+    if( consumed != PRODUCER_COUNT * ITEM_COUNT || consumed_sum != expected_sum )
+    {
+        std::cerr << "FAILED: consumed " << consumed << " items, sum " << consumed_sum
+                  << " expected " << expected_sum << "\n";
+        return false;
+    }
+    return true;
+}
+/**
+ * @brief many threads call notify_one() while woken detached waiters exit
+ *
+ * Stack s are not pooled, so finished waiter Stack is unmapped right away and
+ * notifier touching woken waiter would crash.
+ * @return true on success
+ */
+bool check_concurrent_notify()
+{
+    constexpr int NOTIFIER_COUNT = 4;
+    constexpr int WAITER_COUNT   = 256;
+    constexpr int WAIT_COUNT     = 32;
+
+    StackPool::instance().set_thread_cache_size( 0 );
+    StackPool::instance().set_max_global( 0 );
+    Mutex mutex;
+    ConditionVariable cond_var;
+    std::atomic<int> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( int i = 0; i < WAITER_COUNT; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            std::unique_lock<Mutex> lock( mutex );
+            for( int n = 0; n < WAIT_COUNT; ++n )
+            {
+                cond_var.wait( lock );
+            }
+            ++finished;
+        }, options );
+    }
+    std::atomic<bool> stop{ false };
+    std::vector<std::thread> notifiers;
+    for( int i = 0; i < NOTIFIER_COUNT; ++i )
+    {
+        notifiers.emplace_back( [&]
+        {
+            while( !stop )
+            {
+                cond_var.notify_one();
+            }
+        } );
+    }
+    const bool is_done = wait_for( [&]{ return finished == WAITER_COUNT; } );
+    stop = true;
+    for( auto& notifier: notifiers )
+    {
+        notifier.join();
+    }
+    StackPool::instance().set_thread_cache_size( 16 );
+    StackPool::instance().set_max_global( 256 );
+    if( !is_done )
+    {
+        std::cerr << "FAILED: only " << finished << " of " << WAITER_COUNT
+                  << " notified Tasks finished\n";
+        return false;
+    }
+    return true;
+}
+}
+/**
+ * @brief check Semaphore and ConditionVariable park Tasks without losing wakeups
+ * @return 0 on success
+ */
+int main()
+{
+    BgRunner::set_thread_limits( 4, 4 );
+    if( !check_semaphore()
+            || !check_condition_variable()
+            || !check_concurrent_notify() )
+    {
+        return EXIT_FAILURE;
+    }
+    std::cout << "Semaphore and ConditionVariable OK\n";
+    return EXIT_SUCCESS;
+}
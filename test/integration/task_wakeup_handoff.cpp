@@ -0,0 +1,89 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+using alterstack::Awaitable;
+using alterstack::BgRunner;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+/**
+ * @brief check Task released while it is still switching out to wait is
+ * enqueued exactly once (releaser does not wait for waiter context)
+ * @return 0 on success
+ */
+int main()
+{
+    constexpr int ROUND_COUNT = 2000;
+    constexpr int PAIR_COUNT  = 8;
+    BgRunner::set_thread_limits( 4, 4 );
+
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    std::atomic<int> woken{ 0 };
+    std::atomic<int> finished{ 0 };
+    for( int round = 0; round < ROUND_COUNT; ++round )
+    {
+        std::shared_ptr<Awaitable> awaitables[ PAIR_COUNT ];
+        for( auto& awaitable: awaitables )
+        {
+            awaitable = std::make_shared<Awaitable>();
+            Task::spawn_detached( [awaitable, &woken, &finished]
+            {
+                awaitable->wait();
+                ++woken;
+                ++finished;
+            }, options );
+            Task::spawn_detached( [awaitable, &finished]
+            {
+                awaitable->release();
+                ++finished;
+            }, options );
+        }
+    }
+    const int expected = ROUND_COUNT * PAIR_COUNT;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+    while( finished != expected * 2 )
+    {
+        if( std::chrono::steady_clock::now() > deadline )
+        {
+            std::cerr << "FAILED: only " << woken << " of " << expected << " Tasks woken up\n";
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    alterstack::Scheduler::instance().wait_detached_tasks();
+    if( woken != expected )
+    {
+        std::cerr << "FAILED: " << woken << " wake ups for " << expected << " waiting Tasks\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << woken << " Tasks woken up\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+using alterstack::Awaitable;
+using alterstack::BgRunner;
+using alterstack::Event;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+using Clock = std::chrono::steady_clock;
+
+static void wait_for( const std::atomic<uint32_t>& counter, uint32_t value )
+{
+    while( counter.load() != value )
+    {
+        std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+    }
+}
+
+static double seconds_since( Clock::time_point start )
+{
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+/**
+ * @brief Task pairs ping-pong through two Events each, reusing them every round
+ * @param pair_count Task pairs
+ * @param round_count rounds per pair
+ */
+static void measure_ping_pong( uint32_t pair_count, uint32_t round_count )
+{
+    struct Pair
+    {
+        Event ping;
+        Event pong;
+    };
+    std::unique_ptr<Pair[]> pairs( new Pair[ pair_count ] );
+    std::atomic<uint32_t> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+
+    auto start = Clock::now();
+    for( uint32_t i = 0; i < pair_count; ++i )
+    {
+        Pair* pair = &pairs[i];
+        Task::spawn_detached( [pair, round_count, &finished]
+        {
+            for( uint32_t round = 0; round < round_count; ++round )
+            {
+                pair->ping.set();
+                pair->pong.wait();
+                pair->pong.reset();
+            }
+            ++finished;
+        }, options );
+        Task::spawn_detached( [pair, round_count, &finished]
+        {
+            for( uint32_t round = 0; round < round_count; ++round )
+            {
+                pair->ping.wait();
+                pair->ping.reset();
+                pair->pong.set();
+            }
+            ++finished;
+        }, options );
+    }
+    wait_for( finished, pair_count * 2 );
+    double seconds = seconds_since( start );
+    std::cout << "ping-pong: " << pair_count << " pairs, "
+              << pair_count * uint64_t( round_count ) * 2 / seconds / 1e6
+              << " M set/wait/reset cycles/s\n";
+}
+/**
+ * @brief threads set() and reset() one Event while Tasks wait() on it in loop
+ * @param setter_count OS threads toggling Event
+ * @param waiter_count Tasks waiting Event
+ * @param toggle_count set()/reset() pairs per setter
+ */
+static void measure_storm( uint32_t setter_count, uint32_t waiter_count, uint32_t toggle_count )
+{
+    Event event;
+    std::atomic<bool> is_stopped{ false };
+    std::atomic<uint64_t> passed{ 0 };
+    std::atomic<uint32_t> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+
+    auto start = Clock::now();
+    for( uint32_t i = 0; i < waiter_count; ++i )
+    {
+        Task::spawn_detached( [&]
+        {
+            while( !is_stopped.load() )
+            {
+                event.wait();
+                ++passed;
+                Task::yield();
+            }
+            ++finished;
+        }, options );
+    }
+    std::vector<std::thread> setters;
+    for( uint32_t i = 0; i < setter_count; ++i )
+    {
+        setters.emplace_back( [&event, toggle_count]
+        {
+            for( uint32_t n = 0; n < toggle_count; ++n )
+            {
+                event.set();
+                event.reset();
+            }
+        } );
+    }
+    for( auto& setter: setters )
+    {
+        setter.join();
+    }
+    is_stopped = true;
+    event.set();
+    wait_for( finished, waiter_count );
+    double seconds = seconds_since( start );
+    std::cout << "storm: " << setter_count << " setters, " << waiter_count << " waiters, "
+              << setter_count * uint64_t( toggle_count ) / seconds / 1e6
+              << " M set/reset/s, " << passed << " wait() passes, all waiters woken up\n";
+}
+/**
+ * @brief stress resettable Event with many concurrent set/wait/reset cycles
+ *
+ * Usage: load_event [pair_count [round_count]]
+ *
+ * Event state is single std::atomic<AwaitableData> word changed only by CAS,
+ * no thread ever waits for other one inside set()/reset()/wait() (Tasks wait
+ * by parking), the test finishing shows no wakeup is lost.
+ * @return 0 on success
+ */
+int main( int argc, char* argv[] )
+{
+    uint32_t pair_count  = 256;
+    uint32_t round_count = 2000;
+    if( argc > 1 )
+    {
+        pair_count = std::strtoul( argv[1], nullptr, 10 );
+    }
+    if( argc > 2 )
+    {
+        round_count = std::strtoul( argv[2], nullptr, 10 );
+    }
+    std::atomic<Awaitable::AwaitableData> data{ Awaitable::AwaitableData{} };
+    std::cout << "std::atomic<AwaitableData>::is_lock_free(): " << std::boolalpha
+              << data.is_lock_free() << "\n";
+
+    BgRunner::set_thread_limits( 4, 4 );
+    measure_ping_pong( pair_count, round_count );
+    measure_storm( 4, 64, round_count * 50 );
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "alterstack/intrusive_list.hpp"
+#include "alterstack/lock_free_queue.hpp"
+#include "alterstack/mpmc_ring_queue.hpp"
+#include "alterstack/multi_level_queue.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+class Item : public alterstack::IntrusiveList<Item>
+{
+public:
+    int64_t  enqueued_ns = 0;
+    uint32_t producer    = 0;
+    uint32_t sequence    = 0;
+};
+
+constexpr uint32_t PRODUCERS  = 2;
+constexpr uint32_t CONSUMERS  = 2;
+constexpr uint32_t ITEMS_PER_PRODUCER = 200000;
+constexpr uint32_t MAX_IN_FLIGHT = 256; ///< queue depth producers keep
+
+alterstack::LockFreeQueue<Item>   lock_free_queue;
+alterstack::MultiLevelQueue<Item> multi_level_queue;
+alterstack::MpmcRingQueue<Item>   mpmc_ring_queue;
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now().time_since_epoch() ).count();
+}
+/**
+ * @brief run producers and consumers on queue, report throughput,
+ * enqueue to dequeue latency percentiles and FIFO order violations
+ * @param name queue name
+ * @param queue queue to test
+ */
+template<typename Queue>
+static void measure( const char* name, Queue& queue )
+{
+    std::vector<Item> items( PRODUCERS * ITEMS_PER_PRODUCER );
+    std::vector<std::vector<int64_t>> latency( CONSUMERS );
+    std::vector<uint64_t> reordered( CONSUMERS, 0 );
+    std::atomic<uint32_t> in_flight{ 0 };
+    std::atomic<uint32_t> dequeued{ 0 };
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for( uint32_t p = 0; p < PRODUCERS; ++p )
+    {
+        threads.emplace_back( [&, p]
+        {
+            for( uint32_t i = 0; i < ITEMS_PER_PRODUCER; ++i )
+            {
+                while( in_flight.load( std::memory_order_relaxed ) >= MAX_IN_FLIGHT )
+                {
+                    std::this_thread::yield();
+                }
+                Item& item = items[ p * ITEMS_PER_PRODUCER + i ];
+                item.producer    = p;
+                item.sequence    = i;
+                item.enqueued_ns = now_ns();
+                in_flight.fetch_add( 1, std::memory_order_relaxed );
+                queue.put_item( &item, 1 );
+            }
+        } );
+    }
+    for( uint32_t c = 0; c < CONSUMERS; ++c )
+    {
+        threads.emplace_back( [&, c]
+        {
+            std::vector<int64_t> last_sequence( PRODUCERS, -1 );
+            latency[c].reserve( items.size() );
+            bool have_more_items = false;
+            while( dequeued.load( std::memory_order_relaxed ) < items.size() )
+            {
+                Item* item = queue.get_item( have_more_items );
+                if( item == nullptr )
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                latency[c].push_back( now_ns() - item->enqueued_ns );
+                if( int64_t( item->sequence ) < last_sequence[ item->producer ] )
+                {
+                    ++reordered[c];
+                }
+                last_sequence[ item->producer ] = item->sequence;
+                in_flight.fetch_sub( 1, std::memory_order_relaxed );
+                dequeued.fetch_add( 1, std::memory_order_relaxed );
+            }
+        } );
+    }
+    for( auto& thread: threads )
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    std::vector<int64_t> all;
+    uint64_t reordered_count = 0;
+    for( uint32_t c = 0; c < CONSUMERS; ++c )
+    {
+        all.insert( all.end(), latency[c].begin(), latency[c].end() );
+        reordered_count += reordered[c];
+    }
+    std::sort( all.begin(), all.end() );
+    size_t count = all.size();
+    std::cout << name << ": " << count / seconds / 1e6 << " M items/s"
+              << ", latency p50 " << all[ count / 2 ] / 1000.0
+              << " us, p99 " << all[ count * 99 / 100 ] / 1000.0
+              << " us, p99.9 " << all[ count * 999 / 1000 ] / 1000.0
+              << " us, out of order " << reordered_count << "\n";
+}
+/**
+ * @brief compare running queue implementations (LockFreeQueue, MultiLevelQueue and
+ * MpmcRingQueue) with the same priority items
+ */
+int main()
+{
+    std::cout << PRODUCERS << " producers, " << CONSUMERS << " consumers, "
+              << MAX_IN_FLIGHT << " items in flight\n";
+    measure( "LockFreeQueue  ", lock_free_queue );
+    measure( "MultiLevelQueue", multi_level_queue );
+    measure( "MpmcRingQueue  ", mpmc_ring_queue );
+    return 0;
+}
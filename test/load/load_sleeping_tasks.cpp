@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "alterstack/api.hpp"
+#include "alterstack/slab_stack_allocator.hpp"
+
+using alterstack::Awaitable;
+using alterstack::SlabStackAllocator;
+using alterstack::StackGuard;
+using alterstack::StackSize;
+using alterstack::Task;
+using alterstack::TaskOptions;
+
+static Awaitable wakeup;
+
+static size_t vma_count()
+{
+    std::ifstream maps( "/proc/self/maps" );
+    std::string line;
+    size_t count = 0;
+    while( std::getline( maps, line ) )
+    {
+        ++count;
+    }
+    return count;
+}
+/**
+ * @brief spawn many sleeping Task s with Stack s from SlabStackAllocator
+ *
+ * Usage: load_sleeping_tasks [task_count [guard]]
+ *
+ * Each Task waits on single Awaitable, so all of them are alive at the same time.
+ * With separate mmap() per Stack process hits vm.max_map_count at about 32k Task s.
+ * @return 0 on success
+ */
+int main( int argc, char* argv[] )
+{
+    size_t count = 500000;
+    if( argc > 1 )
+    {
+        count = std::strtoull( argv[1], nullptr, 10 );
+    }
+    bool guarded = ( argc > 2 && std::strcmp( argv[2], "guard" ) == 0 );
+
+    SlabStackAllocator allocator;
+    TaskOptions options;
+    options.stack_size = StackSize::Size16K;
+    options.stack_guard = guarded ? StackGuard::Default : StackGuard::None;
+    options.stack_allocator = &allocator;
+
+    std::vector<std::unique_ptr<Task>> tasks;
+    tasks.reserve( count );
+    auto begin = std::chrono::steady_clock::now();
+    for( size_t i = 0; i < count; ++i )
+    {
+        tasks.emplace_back( new Task( []{ wakeup.wait(); }, options ) );
+    }
+    auto spawned = std::chrono::steady_clock::now();
+    std::cout << count << " sleeping Task s spawned in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>( spawned - begin ).count()
+              << " ms, " << allocator.slab_count() << " slabs, "
+              << vma_count() << " VMAs\n";
+
+    wakeup.release();
+    tasks.clear();
+    auto finished = std::chrono::steady_clock::now();
+    std::cout << "all Task s finished in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>( finished - spawned ).count()
+              << " ms\n";
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+
+#include "alterstack/api.hpp"
+#include "alterstack/stack_pool.hpp"
+
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+using alterstack::StackPool;
+
+static uint64_t spawn_tasks( uint64_t count )
+{
+    auto begin = std::chrono::steady_clock::now();
+    for( uint64_t i = 0; i < count; ++i )
+    {
+        Task task{ []{} };
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( end - begin ).count();
+}
+
+static uint64_t spawn_embedded_tasks( uint64_t count )
+{
+    auto begin = std::chrono::steady_clock::now();
+    for( uint64_t i = 0; i < count; ++i )
+    {
+        Task::spawn( []{} );
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( end - begin ).count();
+}
+/**
+ * @brief spawn count detached Tasks with launch policy and wait all finished
+ * @param count Task count
+ * @param launch TaskLaunch::Immediate or TaskLaunch::Enqueue
+ * @param spawn_ns time spent by spawning loop (producer side)
+ * @return elapsed nanoseconds until all Tasks finished
+ */
+static uint64_t spawn_detached_tasks( uint64_t count, TaskLaunch launch, uint64_t& spawn_ns )
+{
+    std::atomic<uint64_t> finished{ 0 };
+    TaskOptions options;
+    options.launch = launch;
+    auto begin = std::chrono::steady_clock::now();
+    for( uint64_t i = 0; i < count; ++i )
+    {
+        Task::spawn_detached( [&finished]{ ++finished; }, options );
+    }
+    auto spawned = std::chrono::steady_clock::now();
+    while( finished != count )
+    {
+        Task::yield();
+    }
+    auto end = std::chrono::steady_clock::now();
+    spawn_ns = std::chrono::duration_cast<std::chrono::nanoseconds>( spawned - begin ).count();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( end - begin ).count();
+}
+/**
+ * @brief spawn count Tasks with 64 byte capture
+ *
+ * std::function heap allocates such capture, direct callable is constructed
+ * in place at Stack top.
+ * @param count Task count
+ * @param use_function wrap callable into std::function<void()> before spawn
+ * @return elapsed nanoseconds
+ */
+static uint64_t spawn_capture_tasks( uint64_t count, bool use_function )
+{
+    uint64_t data[8] = {};
+    auto begin = std::chrono::steady_clock::now();
+    for( uint64_t i = 0; i < count; ++i )
+    {
+        data[0] = i;
+        auto runnable = [data]{ volatile uint64_t sink = data[0]; (void)sink; };
+        if( use_function )
+        {
+            Task task{ std::function<void()>{ runnable } };
+        }
+        else
+        {
+            Task task{ runnable };
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( end - begin ).count();
+}
+
+static void report( const char* name, uint64_t count, uint64_t ns )
+{
+    std::cout << name << ": " << count << " tasks in " << ns / 1000000 << " ms, "
+              << ( count * 1000000000ull ) / ( ns ? ns : 1 ) << " tasks/s, "
+              << ns / count << " ns/task\n";
+}
+/**
+ * @brief compare Task spawn throughput with and without StackPool
+ * and with std::function vs in place constructed runnable.
+ * Task::spawn() places Task itself at the top of its Stack.
+ * Immediate vs Enqueue launch policy shows producer side cost of spawning.
+ *
+ * Pool disabled (thread cache and global list size 0) is the same as
+ * mmap()/munmap() Stack per Task.
+ * @return 0 on success
+ */
+int main( int argc, char* argv[] )
+{
+    uint64_t count = 100000;
+    if( argc > 1 )
+    {
+        count = std::strtoull( argv[1], nullptr, 10 );
+    }
+    StackPool& pool = StackPool::instance();
+
+    pool.set_thread_cache_size( 0 );
+    pool.set_max_global( 0 );
+    spawn_tasks( count / 10 ); // warm up
+    report( "mmap per Task", count, spawn_tasks( count ) );
+
+    pool.set_thread_cache_size( 16 );
+    pool.set_max_global( 256 );
+    spawn_tasks( count / 10 );
+    report( "StackPool    ", count, spawn_tasks( count ) );
+    spawn_embedded_tasks( count / 10 );
+    report( "Task::spawn  ", count, spawn_embedded_tasks( count ) );
+
+    uint64_t spawn_ns = 0;
+    spawn_detached_tasks( count / 10, TaskLaunch::Immediate, spawn_ns );
+    uint64_t total_ns = spawn_detached_tasks( count, TaskLaunch::Immediate, spawn_ns );
+    report( "Immediate    ", count, total_ns );
+    report( "  producer   ", count, spawn_ns );
+    spawn_detached_tasks( count / 10, TaskLaunch::Enqueue, spawn_ns );
+    total_ns = spawn_detached_tasks( count, TaskLaunch::Enqueue, spawn_ns );
+    report( "Enqueue      ", count, total_ns );
+    report( "  producer   ", count, spawn_ns );
+
+    spawn_capture_tasks( count / 10, true );
+    report( "std::function", count, spawn_capture_tasks( count, true ) );
+    spawn_capture_tasks( count / 10, false );
+    report( "callable     ", count, spawn_capture_tasks( count, false ) );
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "alterstack/api.hpp"
+#include "alterstack/bg_runner.hpp"
+
+using alterstack::BgRunner;
+using alterstack::Task;
+using alterstack::TaskLaunch;
+using alterstack::TaskOptions;
+
+using Clock = std::chrono::steady_clock;
+
+static void busy_wait( std::chrono::microseconds duration )
+{
+    auto end = Clock::now() + duration;
+    while( Clock::now() < end )
+    {}
+}
+/**
+ * @brief measure latency from Task enqueue until BgThread starts it
+ * @param count Task count
+ * @param gap pause between Tasks (BgThread becomes idle)
+ * @return sorted latencies in nanoseconds
+ */
+static std::vector<int64_t> measure( uint32_t count, std::chrono::microseconds gap )
+{
+    std::vector<int64_t> latency( count );
+    std::atomic<uint32_t> finished{ 0 };
+    TaskOptions options;
+    options.launch = TaskLaunch::Enqueue;
+    for( uint32_t i = 0; i < count; ++i )
+    {
+        Clock::time_point enqueued = Clock::now();
+        Task::spawn_detached( [&latency, &finished, enqueued, i]
+        {
+            latency[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - enqueued ).count();
+            ++finished;
+        }, options );
+        busy_wait( gap );
+    }
+    while( finished != count )
+    {
+        busy_wait( gap );
+    }
+    std::sort( latency.begin(), latency.end() );
+    return latency;
+}
+
+static void report( const char* name, const std::vector<int64_t>& latency )
+{
+    size_t count = latency.size();
+    std::cout << name << ": p50 " << latency[ count / 2 ] / 1000.0
+              << " us, p99 " << latency[ count * 99 / 100 ] / 1000.0
+              << " us, max " << latency[ count - 1 ] / 1000.0 << " us\n";
+}
+/**
+ * @brief compare Task wakeup latency of idle BgThread with and without spin phase
+ *
+ * Usage: load_wakeup_latency [task_count [gap_us]]
+ *
+ * Main thread enqueues Task s with pauses, so BgThread becomes idle between them
+ * and has to be woken up (or find Task while spinning).
+ * @return 0 on success
+ */
+int main( int argc, char* argv[] )
+{
+    uint32_t count = 10000;
+    int64_t gap_us = 20;
+    if( argc > 1 )
+    {
+        count = std::strtoul( argv[1], nullptr, 10 );
+    }
+    if( argc > 2 )
+    {
+        gap_us = std::strtoll( argv[2], nullptr, 10 );
+    }
+    std::chrono::microseconds gap{ gap_us };
+
+    BgRunner::set_spin_limits( 0, 0 );
+    measure( count / 10, gap ); // warm up
+    report( "park at once", measure( count, gap ) );
+
+    BgRunner::set_spin_limits( 256, 0 );
+    measure( count / 10, gap );
+    report( "spin 256    ", measure( count, gap ) );
+
+    BgRunner::set_spin_limits( 4096, 0 );
+    measure( count / 10, gap );
+    report( "spin 4096   ", measure( count, gap ) );
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <sched.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <catch.hpp>
+
+#include "alterstack/cpu_topology.hpp"
+
+using alterstack::CpuTopology;
+
+TEST_CASE("CpuTopology")
+{
+    const CpuTopology& topology = CpuTopology::instance();
+    REQUIRE( topology.core_count() > 0 );
+    REQUIRE( topology.numa_node_count() > 0 );
+    SECTION( "every core has CPUs and valid NUMA node" )
+    {
+        for( uint32_t core = 0; core < topology.core_count(); ++core )
+        {
+            REQUIRE( !topology.core_cpus( core ).empty() );
+            REQUIRE( topology.numa_node( core ) < topology.numa_node_count() );
+        }
+    }
+    SECTION( "CPU NUMA node is the node of it's core" )
+    {
+        for( uint32_t core = 0; core < topology.core_count(); ++core )
+        {
+            for( uint32_t cpu: topology.core_cpus( core ) )
+            {
+                REQUIRE( topology.cpu_numa_node( cpu ) == topology.numa_node( core ) );
+            }
+        }
+        REQUIRE( topology.current_numa_node() < topology.numa_node_count() );
+    }
+    SECTION( "distance is symmetric and zero only for the same core" )
+    {
+        for( uint32_t a = 0; a < topology.core_count(); ++a )
+        {
+            for( uint32_t b = 0; b < topology.core_count(); ++b )
+            {
+                REQUIRE( topology.distance( a, b ) == topology.distance( b, a ) );
+                REQUIRE( ( topology.distance( a, b ) == CpuTopology::SameCore ) == ( a == b ) );
+            }
+        }
+    }
+    SECTION( "thread bound to core runs on its CPU" )
+    {
+        const uint32_t core = topology.core_count() - 1;
+        bool on_core = false;
+        std::thread thread( [&]
+        {
+            if( !topology.bind_current_thread( core ) )
+            {
+                return;
+            }
+            std::this_thread::yield();
+            const auto& cpus = topology.core_cpus( core );
+            on_core = std::find( cpus.begin(), cpus.end(), uint32_t( ::sched_getcpu() ) ) != cpus.end();
+        } );
+        thread.join();
+        REQUIRE( on_core );
+        REQUIRE( !topology.bind_current_thread( topology.core_count() ) );
+    }
+}
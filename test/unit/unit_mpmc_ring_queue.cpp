@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "alterstack/intrusive_list.hpp"
+#include "alterstack/mpmc_ring_queue.hpp"
+
+class Item: public alterstack::IntrusiveList<Item>
+{
+};
+
+using ItemsQueue = alterstack::MpmcRingQueue<Item, 16>;
+
+TEST_CASE("MpmcRingQueue")
+{
+    ItemsQueue queue;
+    bool have_more_items = false;
+    SECTION( "empty MpmcRingQueue returns nullptr" )
+    {
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+        REQUIRE( !have_more_items );
+        REQUIRE( queue.depth( 0 ) == 0 );
+    }
+    SECTION( "items are FIFO ordered, priority ignored" )
+    {
+        std::vector<Item> items( 10 );
+        for( size_t i = 0; i < items.size(); ++i )
+        {
+            queue.put_item( &items[i], uint32_t( i % 4 ) );
+        }
+        REQUIRE( queue.depth( 0 ) == items.size() );
+        for( size_t i = 0; i < items.size(); ++i )
+        {
+            have_more_items = false;
+            REQUIRE( queue.get_item( have_more_items ) == &items[i] );
+            REQUIRE( have_more_items == ( i + 1 != items.size() ) );
+        }
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+    }
+    SECTION( "items above capacity keep FIFO order" )
+    {
+        std::vector<Item> items( 40 );
+        for( auto& item: items )
+        {
+            queue.put_item( &item, 1 );
+        }
+        REQUIRE( queue.depth( 0 ) == items.size() );
+        for( size_t i = 0; i < 20; ++i )
+        {
+            REQUIRE( queue.get_item( have_more_items ) == &items[i] );
+        }
+        std::vector<Item> more( 4 );
+        for( auto& item: more )
+        {
+            queue.put_item( &item, 1 );
+        }
+        for( size_t i = 20; i < items.size(); ++i )
+        {
+            REQUIRE( queue.get_item( have_more_items ) == &items[i] );
+        }
+        for( auto& item: more )
+        {
+            REQUIRE( queue.get_item( have_more_items ) == &item );
+        }
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+    }
+    SECTION( "concurrent producers and consumers get every item once" )
+    {
+        constexpr int THREADS = 4;
+        constexpr int ITEMS_PER_THREAD = 10000;
+        std::vector<Item> items( THREADS * ITEMS_PER_THREAD );
+        std::vector<std::atomic<int>> seen( items.size() );
+        std::atomic<int> dequeued{ 0 };
+        std::vector<std::thread> threads;
+        for( int t = 0; t < THREADS; ++t )
+        {
+            threads.emplace_back( [&, t]
+            {
+                for( int i = 0; i < ITEMS_PER_THREAD; ++i )
+                {
+                    queue.put_item( &items[ t * ITEMS_PER_THREAD + i ], 1 );
+                }
+            } );
+            threads.emplace_back( [&]
+            {
+                bool more = false;
+                while( dequeued.load() < THREADS * ITEMS_PER_THREAD )
+                {
+                    Item* item = queue.get_item( more );
+                    if( item != nullptr )
+                    {
+                        ++seen[ item - items.data() ];
+                        ++dequeued;
+                    }
+                }
+            } );
+        }
+        for( auto& thread: threads )
+        {
+            thread.join();
+        }
+        for( auto& count: seen )
+        {
+            REQUIRE( count == 1 );
+        }
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+    }
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <thread>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "alterstack/intrusive_list.hpp"
+#include "alterstack/multi_level_queue.hpp"
+
+class Item: public alterstack::IntrusiveList<Item>
+{
+public:
+    uint32_t level = 0;
+};
+
+using ItemsQueue = alterstack::MultiLevelQueue<Item, 4>;
+
+TEST_CASE("MultiLevelQueue")
+{
+    ItemsQueue queue;
+    bool have_more_items = false;
+    SECTION( "empty MultiLevelQueue returns nullptr" )
+    {
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+        REQUIRE( !have_more_items );
+    }
+    SECTION( "items of one level are FIFO ordered" )
+    {
+        std::vector<Item> items( 10 );
+        for( auto& item: items )
+        {
+            queue.put_item( &item, 3 );
+        }
+        REQUIRE( queue.depth( 3 ) == items.size() );
+        for( size_t i = 0; i < items.size(); ++i )
+        {
+            have_more_items = false;
+            REQUIRE( queue.get_item( have_more_items ) == &items[i] );
+            REQUIRE( have_more_items == ( i + 1 != items.size() ) );
+        }
+        REQUIRE( queue.depth( 3 ) == 0 );
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+    }
+    SECTION( "too low priority goes to the lowest level" )
+    {
+        Item item;
+        queue.put_item( &item, 100 );
+        REQUIRE( queue.depth( 3 ) == 1 );
+        REQUIRE( queue.get_item( have_more_items ) == &item );
+    }
+    SECTION( "levels get dequeues by weight, lowest level does not starve" )
+    {
+        constexpr uint32_t PERIODS = 10;
+        std::vector<Item> items( 4 * ItemsQueue::WEIGHT_PERIOD * PERIODS );
+        for( size_t i = 0; i < items.size(); ++i )
+        {
+            items[i].level = static_cast<uint32_t>( i % 4 );
+            queue.put_item( &items[i], items[i].level );
+        }
+        uint32_t dequeued[4] = {};
+        for( uint32_t i = 0; i < ItemsQueue::WEIGHT_PERIOD * PERIODS; ++i )
+        {
+            Item* item = queue.get_item( have_more_items );
+            REQUIRE( item != nullptr );
+            ++dequeued[ item->level ];
+        }
+        REQUIRE( dequeued[0] == 8 * PERIODS );
+        REQUIRE( dequeued[1] == 4 * PERIODS );
+        REQUIRE( dequeued[2] == 2 * PERIODS );
+        REQUIRE( dequeued[3] == 1 * PERIODS );
+    }
+    SECTION( "empty preferred level gives dequeue to higher levels first" )
+    {
+        std::vector<Item> high( ItemsQueue::WEIGHT_PERIOD );
+        std::vector<Item> low( ItemsQueue::WEIGHT_PERIOD );
+        for( size_t i = 0; i < high.size(); ++i )
+        {
+            high[i].level = 0;
+            low[i].level  = 3;
+            queue.put_item( &high[i], 0 );
+            queue.put_item( &low[i], 3 );
+        }
+        uint32_t low_count = 0;
+        for( uint32_t i = 0; i < ItemsQueue::WEIGHT_PERIOD; ++i )
+        {
+            low_count += queue.get_item( have_more_items )->level == 3 ? 1 : 0;
+        }
+        REQUIRE( low_count == 1 );
+        REQUIRE( queue.depth( 0 ) == 1 );
+        REQUIRE( queue.depth( 3 ) == ItemsQueue::WEIGHT_PERIOD - 1 );
+    }
+    SECTION( "get_item_except skips level and gives its turns to caller" )
+    {
+        Item normal;
+        queue.put_item( &normal, 1 );
+        REQUIRE_FALSE( queue.has_items_except( 1 ) );
+        REQUIRE( queue.has_items_except( 0 ) );
+        REQUIRE( queue.get_item_except( 1, have_more_items ) == nullptr );
+        std::vector<Item> items( 4 * ItemsQueue::WEIGHT_PERIOD );
+        for( size_t i = 0; i < items.size(); ++i )
+        {
+            items[i].level = static_cast<uint32_t>( i % 4 );
+            queue.put_item( &items[i], items[i].level );
+        }
+        REQUIRE( queue.has_items_except( 1 ) );
+        uint32_t dequeued[4] = {};
+        uint32_t skipped = 0;
+        for( uint32_t i = 0; i < ItemsQueue::WEIGHT_PERIOD; ++i )
+        {
+            Item* item = queue.get_item_except( 1, have_more_items );
+            if( item == nullptr )
+            {
+                ++skipped;
+                continue;
+            }
+            ++dequeued[ item->level ];
+        }
+        REQUIRE( dequeued[0] == 8 );
+        REQUIRE( dequeued[1] == 0 );
+        REQUIRE( dequeued[2] == 2 );
+        REQUIRE( dequeued[3] == 1 );
+        REQUIRE( skipped == 4 );
+    }
+    SECTION( "concurrent producers and consumers get every item once" )
+    {
+        constexpr int THREADS = 4;
+        constexpr int ITEMS_PER_THREAD = 10000;
+        std::vector<Item> items( THREADS * ITEMS_PER_THREAD );
+        std::vector<std::atomic<int>> seen( items.size() );
+        std::atomic<int> dequeued{ 0 };
+        std::vector<std::thread> threads;
+        for( int t = 0; t < THREADS; ++t )
+        {
+            threads.emplace_back( [&, t]
+            {
+                for( int i = 0; i < ITEMS_PER_THREAD; ++i )
+                {
+                    queue.put_item( &items[ t * ITEMS_PER_THREAD + i ], uint32_t( i % 4 ) );
+                }
+            } );
+            threads.emplace_back( [&]
+            {
+                bool more = false;
+                while( dequeued.load() < THREADS * ITEMS_PER_THREAD )
+                {
+                    Item* item = queue.get_item( more );
+                    if( item != nullptr )
+                    {
+                        ++seen[ item - items.data() ];
+                        ++dequeued;
+                    }
+                }
+            } );
+        }
+        for( auto& thread: threads )
+        {
+            thread.join();
+        }
+        for( auto& count: seen )
+        {
+            REQUIRE( count == 1 );
+        }
+        REQUIRE( queue.get_item( have_more_items ) == nullptr );
+    }
+}
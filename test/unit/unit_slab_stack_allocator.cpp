@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "alterstack/slab_stack_allocator.hpp"
+
+using alterstack::SlabStackAllocator;
+using alterstack::Stack;
+using alterstack::StackGuard;
+using alterstack::StackSize;
+
+TEST_CASE("SlabStackAllocator")
+{
+    SlabStackAllocator allocator( 1024*1024 );
+    SECTION( "one slab holds many Stack s" )
+    {
+        std::vector<Stack*> stacks;
+        for( int i = 0; i < 64; ++i )
+        {
+            stacks.push_back( allocator.allocate( StackSize::Size16K, StackGuard::None ) );
+        }
+        REQUIRE( allocator.slab_count() == 1 );
+        std::set<Stack*> unique( stacks.begin(), stacks.end() );
+        REQUIRE( unique.size() == stacks.size() );
+        for( auto stack: stacks )
+        {
+            REQUIRE( stack->allocator() == &allocator );
+            REQUIRE( stack->size() == 16*1024 );
+            REQUIRE( !stack->is_guarded() );
+            char* top = static_cast<char*>( stack->stack_top() );
+            std::fill( top - stack->size(), top, 1 );
+        }
+        SECTION( "next Stack maps new slab" )
+        {
+            Stack* stack = allocator.allocate( StackSize::Size16K, StackGuard::None );
+            REQUIRE( allocator.slab_count() == 2 );
+            allocator.deallocate( stack );
+        }
+        SECTION( "deallocated Stack is reused" )
+        {
+            allocator.deallocate( stacks.back() );
+            REQUIRE( allocator.allocate( StackSize::Size16K, StackGuard::None ) == stacks.back() );
+        }
+        for( auto stack: stacks )
+        {
+            allocator.deallocate( stack );
+        }
+    }
+    SECTION( "guarded Stack s are separated by guard pages" )
+    {
+        Stack* first  = allocator.allocate( StackSize::Size16K, StackGuard::Default );
+        Stack* second = allocator.allocate( StackSize::Size16K, StackGuard::Default );
+        REQUIRE( first->is_guarded() );
+        REQUIRE( first->size() == 16*1024 );
+        REQUIRE( static_cast<char*>( second->stack_top() ) - static_cast<char*>( first->stack_top() )
+                 == static_cast<ptrdiff_t>( 16*1024 + Stack::page_size() ) );
+        allocator.deallocate( first );
+        allocator.deallocate( second );
+    }
+    SECTION( "Stack without guard pages is reused if default guard pages is 0" )
+    {
+        const uint32_t guard_pages = Stack::default_guard_pages();
+        Stack::set_default_guard_pages( 0 );
+        Stack* stack = allocator.allocate( StackSize::Size16K, StackGuard::Default );
+        REQUIRE( !stack->is_guarded() );
+        allocator.deallocate( stack );
+        REQUIRE( allocator.allocate( StackSize::Size16K, StackGuard::Default ) == stack );
+        allocator.deallocate( stack );
+        Stack::set_default_guard_pages( guard_pages );
+    }
+}
+
+TEST_CASE("SlabStackAllocator with huge pages")
+{
+    for( auto pages: { alterstack::SlabPages::TransparentHuge, alterstack::SlabPages::HugeTLB } )
+    {
+        SlabStackAllocator allocator( 1024*1024, pages );
+        // not guarded Stack s are usable with or without huge pages
+        Stack* stack = allocator.allocate( StackSize::Size64K, StackGuard::None );
+        REQUIRE( stack->size() == 64*1024 );
+        char* top = static_cast<char*>( stack->stack_top() );
+        std::fill( top - stack->size(), top, 1 );
+        REQUIRE( allocator.slab_count() == 1 );
+        REQUIRE( allocator.huge_page_advised_slab_count() <= 1 );
+        allocator.deallocate( stack );
+        // guarded Stack s use normal pages
+        stack = allocator.allocate( StackSize::Size64K, StackGuard::Default );
+        REQUIRE( stack->is_guarded() );
+        REQUIRE( allocator.slab_count() == 2 );
+        REQUIRE( allocator.huge_page_advised_slab_count() <= 1 );
+        allocator.deallocate( stack );
+    }
+}
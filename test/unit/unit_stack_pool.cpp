@@ -0,0 +1,182 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "alterstack/stack_pool.hpp"
+
+using alterstack::Stack;
+using alterstack::StackPool;
+
+static std::set<Stack*> seen_stacks;
+
+static Stack* get_stack( StackPool& pool )
+{
+    Stack* stack = pool.get();
+    seen_stacks.insert( stack );
+    return stack;
+}
+
+TEST_CASE("StackPool")
+{
+    StackPool& pool = StackPool::instance();
+    pool.set_thread_cache_size( 4 );
+    pool.set_max_global( 8 );
+    SECTION( "released Stack is reused by next get()" )
+    {
+        Stack* stack = get_stack( pool );
+        REQUIRE( stack != nullptr );
+        pool.put( stack );
+        REQUIRE( pool.get() == stack );
+        pool.put( stack );
+    }
+    SECTION( "Stack s over thread cache goes to global list and back" )
+    {
+        std::vector<Stack*> stacks;
+        for( int i = 0; i < 8; ++i )
+        {
+            stacks.push_back( get_stack( pool ) );
+        }
+        std::set<Stack*> released( stacks.begin(), stacks.end() );
+        REQUIRE( released.size() == stacks.size() );
+        for( auto stack: stacks )
+        {
+            pool.put( stack );
+        }
+        for( auto& stack: stacks )
+        {
+            stack = get_stack( pool );
+            REQUIRE( released.find( stack ) != released.end() );
+        }
+        for( auto stack: stacks )
+        {
+            pool.put( stack );
+        }
+    }
+    SECTION( "Stack s cached by finished thread are available to others" )
+    {
+        std::thread thread( [&pool]
+        {
+            pool.put( get_stack( pool ) );
+        });
+        thread.join();
+        Stack* stack = nullptr;
+        std::thread fresh_thread( [&stack,&pool]
+        {
+            stack = pool.get();
+        });
+        fresh_thread.join();
+        REQUIRE( seen_stacks.find( stack ) != seen_stacks.end() );
+        pool.put( stack );
+    }
+    SECTION( "reused Stack is writable" )
+    {
+        pool.set_release_memory( true );
+        Stack* stack = pool.get();
+        char* top = static_cast<char*>( stack->stack_top() );
+        top[-1] = 1;
+        pool.put( stack );
+        pool.set_release_memory( false );
+    }
+}
+
+TEST_CASE("Stack size classes")
+{
+    StackPool& pool = StackPool::instance();
+    SECTION( "Stack size matches size class" )
+    {
+        Stack* small = pool.get( alterstack::StackSize::Size16K );
+        Stack* big   = pool.get( alterstack::StackSize::Size1M );
+        REQUIRE( small->size() == 16*1024 );
+        REQUIRE( small->size_class() == alterstack::StackSize::Size16K );
+        REQUIRE( big->size() == 1024*1024 );
+        pool.put( small );
+        pool.put( big );
+        SECTION( "and released Stack is reused only for same size class" )
+        {
+            Stack* stack = pool.get( alterstack::StackSize::Size64K );
+            REQUIRE( stack != small );
+            REQUIRE( stack != big );
+            REQUIRE( stack->size() == 64*1024 );
+            pool.put( stack );
+            REQUIRE( pool.get( alterstack::StackSize::Size16K ) == small );
+            pool.put( small );
+        }
+    }
+    SECTION( "Default size class follows process wide default" )
+    {
+        REQUIRE( Stack::default_size() == alterstack::StackSize::Size1M );
+        Stack::set_default_size( alterstack::StackSize::Size256K );
+        Stack* stack = pool.get();
+        REQUIRE( stack->size_class() == alterstack::StackSize::Size256K );
+        REQUIRE( stack->size() == 256*1024 );
+        pool.put( stack );
+        Stack::set_default_size( alterstack::StackSize::Size1M );
+    }
+}
+
+TEST_CASE("Stack guard pages")
+{
+    StackPool& pool = StackPool::instance();
+    SECTION( "guard pages are not counted in usable size" )
+    {
+        Stack* stack = pool.get( alterstack::StackSize::Size16K );
+        REQUIRE( stack->is_guarded() );
+        REQUIRE( stack->size() == 16*1024 );
+        char* top = static_cast<char*>( stack->stack_top() );
+        std::fill( top - stack->size(), top, 1 );
+        pool.put( stack );
+    }
+    SECTION( "not guarded Stack s are pooled separately" )
+    {
+        Stack* guarded = pool.get( alterstack::StackSize::Size16K );
+        pool.put( guarded );
+        Stack* stack = pool.get( alterstack::StackSize::Size16K, alterstack::StackGuard::None );
+        REQUIRE( stack != guarded );
+        REQUIRE( !stack->is_guarded() );
+        pool.put( stack );
+        REQUIRE( pool.get( alterstack::StackSize::Size16K, alterstack::StackGuard::None ) == stack );
+        pool.put( stack );
+    }
+    SECTION( "Stack without guard pages is reused if default guard pages is 0" )
+    {
+        const uint32_t guard_pages = Stack::default_guard_pages();
+        Stack::set_default_guard_pages( 0 );
+        std::vector<Stack*> cached; // guarded Stack s pooled by previous sections
+        Stack* stack = pool.get( alterstack::StackSize::Size16K );
+        while( stack->is_guarded() )
+        {
+            cached.push_back( stack );
+            stack = pool.get( alterstack::StackSize::Size16K );
+        }
+        REQUIRE( stack->guard() == alterstack::StackGuard::Default );
+        pool.put( stack );
+        REQUIRE( pool.get( alterstack::StackSize::Size16K ) == stack );
+        pool.put( stack );
+        for( auto guarded: cached )
+        {
+            pool.put( guarded );
+        }
+        Stack::set_default_guard_pages( guard_pages );
+    }
+}
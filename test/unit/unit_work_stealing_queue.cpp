@@ -0,0 +1,161 @@
+/*
+ * Copyright 2017 Alexey Syrnikov <san@masterspline.net>
+ *
+ * This file is part of Alterstack.
+ *
+ * Alterstack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Alterstack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Alterstack.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "alterstack/work_stealing_queue.hpp"
+
+struct Item
+{
+    int value = 0;
+};
+
+using ItemsQueue = alterstack::WorkStealingQueue<Item, 16>;
+
+TEST_CASE("API check")
+{
+    ItemsQueue queue;
+    std::vector<Item> items(32);
+    SECTION( "empty WorkStealingQueue returns nullptr" )
+    {
+        REQUIRE( queue.empty() );
+        REQUIRE( queue.pop() == nullptr );
+        REQUIRE( queue.steal() == nullptr );
+    }
+    SECTION( "ring returns items in FIFO order" )
+    {
+        for( int i = 0; i < 10; ++i )
+        {
+            REQUIRE( queue.push( &items[i] ) );
+        }
+        for( int i = 0; i < 10; ++i )
+        {
+            REQUIRE( queue.pop() == &items[i] );
+        }
+        REQUIRE( queue.pop() == nullptr );
+        REQUIRE( queue.empty() );
+    }
+    SECTION( "push to full ring returns false" )
+    {
+        for( int i = 0; i < 16; ++i )
+        {
+            REQUIRE( queue.push( &items[i] ) );
+        }
+        REQUIRE( !queue.push( &items[16] ) );
+        REQUIRE( queue.pop() == &items[0] );
+        REQUIRE( queue.push( &items[16] ) );
+    }
+    SECTION( "LIFO slot item is returned first, previous one moves to ring" )
+    {
+        REQUIRE( queue.push( &items[0] ) );
+        REQUIRE( queue.push_next( &items[1] ) == nullptr );
+        REQUIRE( queue.push_next( &items[2] ) == nullptr );
+        REQUIRE( queue.pop() == &items[2] );
+        REQUIRE( queue.pop() == &items[0] );
+        REQUIRE( queue.pop() == &items[1] );
+        REQUIRE( queue.pop() == nullptr );
+    }
+    SECTION( "push_next returns previous LIFO item if ring is full" )
+    {
+        for( int i = 0; i < 16; ++i )
+        {
+            REQUIRE( queue.push( &items[i] ) );
+        }
+        REQUIRE( queue.push_next( &items[16] ) == nullptr );
+        REQUIRE( queue.push_next( &items[17] ) == &items[16] );
+    }
+    SECTION( "steal takes ring items first and LIFO slot item last" )
+    {
+        REQUIRE( queue.push_next( &items[0] ) == nullptr );
+        REQUIRE( queue.push( &items[1] ) );
+        REQUIRE( queue.steal() == &items[1] );
+        REQUIRE( queue.steal() == &items[0] );
+        REQUIRE( queue.steal() == nullptr );
+        REQUIRE( queue.empty() );
+    }
+}
+
+TEST_CASE("multithreaded steal")
+{
+    constexpr int ITEMS_COUNT = 100000;
+    constexpr int THIEVES_COUNT = 3;
+    std::vector<Item> items( ITEMS_COUNT );
+    ItemsQueue queue;
+    std::atomic<bool> done{ false };
+    std::vector<std::vector<Item*>> stolen( THIEVES_COUNT );
+    std::vector<std::thread> thieves;
+    for( int t = 0; t < THIEVES_COUNT; ++t )
+    {
+        thieves.emplace_back( [&queue, &done, &stolen, t]
+        {
+            while( !done.load() )
+            {
+                Item* item = queue.steal();
+                if( item != nullptr )
+                {
+                    stolen[t].push_back( item );
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } );
+    }
+    std::vector<Item*> owned;
+    for( int i = 0; i < ITEMS_COUNT; ++i )
+    {
+        Item* overflow = ( i % 3 == 0 ) ? queue.push_next( &items[i] )
+                                        : ( queue.push( &items[i] ) ? nullptr : &items[i] );
+        if( overflow != nullptr )
+        {
+            owned.push_back( overflow );
+        }
+        if( i % 2 == 0 )
+        {
+            Item* item = queue.pop();
+            if( item != nullptr )
+            {
+                owned.push_back( item );
+            }
+        }
+    }
+    while( Item* item = queue.pop() )
+    {
+        owned.push_back( item );
+    }
+    done.store( true );
+    for( auto& thief: thieves )
+    {
+        thief.join();
+    }
+    std::set<Item*> seen( owned.begin(), owned.end() );
+    size_t total = owned.size();
+    for( auto& list: stolen )
+    {
+        seen.insert( list.begin(), list.end() );
+        total += list.size();
+    }
+    REQUIRE( total == ITEMS_COUNT );
+    REQUIRE( seen.size() == ITEMS_COUNT );
+}